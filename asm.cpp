@@ -1,5 +1,111 @@
 #include "asm.h"
 
+#include <cstring>
+
+static inline bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+}
+
+bool AsmToken::operator ==(const char *other) const {
+    int other_length = qstrlen(other);
+    return other_length == length && !memcmp(data, other, length);
+}
+
+AsmTokenizer::AsmTokenizer(const char *data, int length) {
+    pos = data;
+    end = data + length;
+}
+
+AsmTokenizer::AsmTokenizer(const QByteArray &data) : AsmTokenizer(data.constData(), data.length()) {
+}
+
+bool AsmTokenizer::next() {
+    while (pos < end) {
+        const char *line = pos;
+        const char *eol = (const char*)memchr(pos, '\n', end - pos);
+        if (!eol) {
+            eol = end;
+        }
+        pos = (eol < end) ? eol + 1 : end;
+
+        // Comments run from '@' to the end of the line, unless it's in a string.
+        // Look for the label colon in the same pass.
+        bool in_string = false;
+        const char *colon = NULL;
+        const char *stop = line;
+        for (; stop < eol; stop++) {
+            if (*stop == '"') {
+                in_string = !in_string;
+            } else if (!in_string) {
+                if (*stop == '@') {
+                    break;
+                } else if (*stop == ':' && !colon) {
+                    colon = stop;
+                }
+            }
+        }
+
+        const char *start = line;
+        while (start < stop && isSpace(*start)) start++;
+        while (stop > start && isSpace(stop[-1])) stop--;
+        if (start == stop) {
+            continue;
+        }
+
+        args.clear();
+
+        if (colon) {
+            // There should not be anything else on the line.
+            // gas will raise a syntax error if there is.
+            const char *label_end = colon;
+            while (label_end > start && isSpace(label_end[-1])) label_end--;
+            is_label = true;
+            macro = AsmToken(start, label_end - start);
+            return true;
+        }
+
+        is_label = false;
+        const char *macro_end = start;
+        while (macro_end < stop && !isSpace(*macro_end)) macro_end++;
+        macro = AsmToken(start, macro_end - start);
+
+        const char *arg = macro_end;
+        while (arg < stop && isSpace(*arg)) arg++;
+        if (arg == stop) {
+            return true;
+        }
+
+        in_string = false;
+        for (const char *c = arg; c <= stop; c++) {
+            if (c == stop || (*c == ',' && !in_string)) {
+                const char *arg_end = c;
+                while (arg < arg_end && isSpace(*arg)) arg++;
+                while (arg_end > arg && isSpace(arg_end[-1])) arg_end--;
+                args.append(AsmToken(arg, arg_end - arg));
+                arg = c + 1;
+            } else if (*c == '"') {
+                in_string = !in_string;
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+QStringList AsmTokenizer::toStringList() const {
+    QStringList list;
+    if (is_label) {
+        list.append(".label"); // This is not a real keyword. It's used only to make the output more regular.
+        list.append(macro.toString());
+    } else {
+        list.append(macro.toString());
+        for (int i = 0; i < args.length(); i++) {
+            list.append(args.at(i).toString());
+        }
+    }
+    return list;
+}
+
 Asm::Asm()
 {
 }
@@ -18,42 +124,188 @@ void Asm::strip_comment(QString *line) {
     }
 }
 
-QList<QStringList>* Asm::parse(QString text) {
-    QList<QStringList> *parsed = new QList<QStringList>;
-    QStringList lines = text.split('\n');
-    for (QString line : lines) {
-        QString label;
-        //QString macro;
-        //QStringList *params;
-        strip_comment(&line);
-        if (line.isEmpty()) {
-        } else if (line.contains(':')) {
-            label = line.left(line.indexOf(':'));
-            QStringList *list = new QStringList;
-            list->append(".label"); // This is not a real keyword. It's used only to make the output more regular.
-            list->append(label);
-            parsed->append(*list);
-            // There should not be anything else on the line.
-            // gas will raise a syntax error if there is.
-        } else {
-            line = line.trimmed();
-            //parsed->append(line.split(QRegExp("\\s*,\\s*")));
-            QString macro;
-            QStringList params;
-            int index = line.indexOf(QRegExp("\\s+"));
-            macro = line.left(index);
-            params = line.right(line.length() - index).trimmed().split(QRegExp("\\s*,\\s*"));
-            params.prepend(macro);
-            parsed->append(params);
-        }
-        //if (macro != NULL) {
-        //    if (macros->contains(macro)) {
-        //        void* function = macros->value(macro);
-        //        if (function != NULL) {
-        //            std::function function(params);
-        //        }
-        //    }
-        //}
+QList<QStringList> Asm::parse(QString text) {
+    return parse(text.toUtf8());
+}
+
+QList<QStringList> Asm::parse(const QByteArray &text) {
+    QList<QStringList> parsed;
+    AsmTokenizer tokenizer(text);
+    while (tokenizer.next()) {
+        parsed.append(tokenizer.toStringList());
     }
     return parsed;
 }
+
+AsmFile::AsmFile()
+{
+}
+
+AsmFile::AsmFile(const QByteArray &text_)
+{
+    parse(text_);
+}
+
+void AsmFile::parse(const QByteArray &text_) {
+    text = text_;
+    commands.clear();
+    labels.clear();
+
+    // Labels can be stacked, so a label's statements start at the first
+    // statement after it, and end at the first label after that.
+    QStringList pending;
+    QStringList open;
+    AsmTokenizer tokenizer(text);
+    while (tokenizer.next()) {
+        int index = commands.length();
+        QStringList command = tokenizer.toStringList();
+        if (tokenizer.is_label) {
+            for (QString label : open) {
+                labels[label].second = index;
+            }
+            open.clear();
+            // Only the first definition of a label is used.
+            QString label = command.value(1);
+            if (!labels.contains(label) && !pending.contains(label)) {
+                pending.append(label);
+            }
+        } else if (!pending.isEmpty()) {
+            for (QString label : pending) {
+                labels.insert(label, qMakePair(index, index));
+            }
+            open = pending;
+            pending.clear();
+        }
+        commands.append(command);
+    }
+    int length = commands.length();
+    for (QString label : open) {
+        labels[label].second = length;
+    }
+    for (QString label : pending) {
+        labels.insert(label, qMakePair(length, length));
+    }
+}
+
+QList<QStringList> AsmFile::getLabelMacros(QString label) {
+    if (!labels.contains(label)) {
+        return QList<QStringList>();
+    }
+    QPair<int, int> range = labels.value(label);
+    return commands.mid(range.first, range.second - range.first);
+}
+
+// For if you don't care about filtering by macro,
+// and just want all values associated with some label.
+QStringList AsmFile::getLabelValues(QString label) {
+    QStringList values;
+    if (!labels.contains(label)) {
+        return values;
+    }
+    QPair<int, int> range = labels.value(label);
+    for (int i = range.first; i < range.second; i++) {
+        const QStringList &params = commands.at(i);
+        // Ignore .align
+        if (params.value(0) == ".align") {
+            continue;
+        }
+        for (int j = 1; j < params.length(); j++) {
+            values.append(params.at(j));
+        }
+    }
+    return values;
+}
+
+AsmWriter::AsmWriter(int reserve) {
+    buffer.reserve(reserve);
+}
+
+void AsmWriter::label(const QString &name) {
+    append(name);
+    append("::\n", 3);
+}
+
+void AsmWriter::macro(const char *name) {
+    buffer.append('\t');
+    append(name, int(strlen(name)));
+    first_arg = true;
+}
+
+void AsmWriter::statement(const char *name, const QString &value) {
+    macro(name);
+    arg(value);
+    end();
+}
+
+void AsmWriter::separate() {
+    if (first_arg) {
+        buffer.append(' ');
+        first_arg = false;
+    } else {
+        append(", ", 2);
+    }
+}
+
+void AsmWriter::arg(const QString &value) {
+    separate();
+    append(value);
+}
+
+void AsmWriter::arg(const char *value) {
+    separate();
+    append(value, int(strlen(value)));
+}
+
+void AsmWriter::arg(int value) {
+    separate();
+    append(value);
+}
+
+void AsmWriter::end() {
+    buffer.append('\n');
+}
+
+void AsmWriter::newline() {
+    buffer.append('\n');
+}
+
+void AsmWriter::append(const char *value, int length) {
+    buffer.append(value, length);
+}
+
+void AsmWriter::append(const QString &value) {
+    const ushort *chars = value.utf16();
+    int length = value.length();
+    for (int i = 0; i < length; i++) {
+        if (chars[i] >= 0x80) {
+            buffer.append(value.toUtf8());
+            return;
+        }
+    }
+    int start = buffer.length();
+    buffer.resize(start + length);
+    char *out = buffer.data() + start;
+    for (int i = 0; i < length; i++) {
+        out[i] = char(chars[i]);
+    }
+}
+
+void AsmWriter::append(int value) {
+    char digits[12];
+    int length = 0;
+    // Work in unsigned so INT_MIN doesn't overflow.
+    unsigned int magnitude = value < 0 ? 0u - unsigned(value) : unsigned(value);
+    do {
+        digits[length++] = char('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+    if (value < 0) {
+        digits[length++] = '-';
+    }
+    int start = buffer.length();
+    buffer.resize(start + length);
+    char *out = buffer.data() + start;
+    for (int i = 0; i < length; i++) {
+        out[i] = digits[length - 1 - i];
+    }
+}
@@ -2,14 +2,111 @@
 #define ASM_H
 
 #include <QString>
+#include <QStringList>
 #include <QList>
+#include <QByteArray>
+#include <QVarLengthArray>
+#include <QHash>
+#include <QPair>
+#include <QDateTime>
+
+// A slice of the buffer being tokenized.
+// It does not own its data, so it is only valid as long as the buffer is.
+class AsmToken
+{
+public:
+    AsmToken() {}
+    AsmToken(const char *data_, int length_) : data(data_), length(length_) {}
+public:
+    const char *data = NULL;
+    int length = 0;
+    bool isEmpty() const {
+        return length == 0;
+    }
+    bool operator ==(const char *) const;
+    bool operator !=(const char *other) const {
+        return !(operator ==(other));
+    }
+    QString toString() const {
+        return QString::fromUtf8(data, length);
+    }
+};
+
+// Walks a UTF-8 buffer one statement at a time.
+// Nothing is copied: the label, macro and args are views into the buffer,
+// and the storage for args is reused between statements.
+class AsmTokenizer
+{
+public:
+    AsmTokenizer(const char *data, int length);
+    explicit AsmTokenizer(const QByteArray &data);
+    bool next();
+    QStringList toStringList() const;
+
+public:
+    bool is_label = false;
+    AsmToken macro; // The label name, if is_label is set.
+    QVarLengthArray<AsmToken, 32> args;
+
+private:
+    const char *pos = NULL;
+    const char *end = NULL;
+};
+
+// Builds asm source straight into a UTF-8 buffer.
+// Integers are formatted in place and ASCII strings are copied without converting,
+// so writing a statement doesn't allocate once the buffer is big enough.
+class AsmWriter
+{
+public:
+    explicit AsmWriter(int reserve = 4096);
+    void label(const QString &name); // name::
+    void macro(const char *name); // Starts a statement. Follow with args, then end().
+    void statement(const char *name, const QString &value); // A whole statement with one arg.
+    void arg(const QString &value);
+    void arg(const char *value);
+    void arg(int value);
+    void end();
+    void newline();
+    QByteArray data() const {
+        return buffer;
+    }
+
+private:
+    void separate();
+    void append(const QString &value);
+    void append(const char *value, int length);
+    void append(int value);
+    QByteArray buffer;
+    bool first_arg = true;
+};
 
 class Asm
 {
 public:
     Asm();
     void strip_comment(QString*);
-    QList<QStringList>* parse(QString);
+    QList<QStringList> parse(QString);
+    QList<QStringList> parse(const QByteArray &);
+};
+
+// A parsed source file, with an index of the statements under each label.
+class AsmFile
+{
+public:
+    AsmFile();
+    explicit AsmFile(const QByteArray &text_);
+    void parse(const QByteArray &text_);
+    QList<QStringList> getLabelMacros(QString label);
+    QStringList getLabelValues(QString label);
+
+public:
+    QString path;
+    QDateTime modified;
+    QByteArray text;
+    QList<QStringList> commands;
+    // label -> [begin, end) in commands. The range never includes a label.
+    QHash<QString, QPair<int, int>> labels;
 };
 
 #endif // ASM_H
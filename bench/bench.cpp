@@ -0,0 +1,148 @@
+#include "projectgenerator.h"
+#include "project.h"
+#include "asm.h"
+#include "map.h"
+
+#include <QtTest>
+#include <QGuiApplication>
+#include <QTemporaryDir>
+
+class Bench : public QObject
+{
+    Q_OBJECT
+
+private:
+    QTemporaryDir dir;
+    GeneratorOptions options;
+    ProjectGenerator *generator = NULL;
+    Project *project = NULL;
+    Map *map = NULL;
+
+private slots:
+    void initTestCase();
+    void parseAsm_data();
+    void parseAsm();
+    void loadMap();
+    void loadTilesetAssets();
+    void render();
+    void renderCollision();
+    void floodFill();
+    void serializeBlockdata();
+};
+
+void Bench::initTestCase() {
+    QVERIFY(dir.isValid());
+    // The defaults are the fixture. Changing them makes results incomparable with older runs.
+    generator = new ProjectGenerator(dir.path(), options);
+    QVERIFY(generator->generate());
+    project = new Project;
+    project->root = dir.path();
+    project->readMapGroups();
+    QCOMPARE(project->mapNames->length(), options.num_maps);
+    map = project->loadMap(generator->getMapName(0));
+    QCOMPARE(map->getWidth(), options.map_width);
+    QCOMPARE(map->getHeight(), options.map_height);
+    QVERIFY(map->tileset_primary && map->tileset_secondary);
+}
+
+void Bench::parseAsm_data() {
+    QTest::addColumn<QString>("path");
+    QTest::newRow("_assets.inc") << "/data/maps/_assets.inc";
+    QTest::newRow("events") << "/data/maps/events/" + generator->getMapName(0) + ".inc";
+    QTest::newRow("graphics.inc") << "/data/tilesets/graphics.inc";
+}
+
+void Bench::parseAsm() {
+    QFETCH(QString, path);
+    QByteArray text = project->readFile(dir.path() + path);
+    QVERIFY(!text.isEmpty());
+    Asm parser;
+    QBENCHMARK {
+        parser.parse(text);
+    }
+}
+
+// A fresh project each time, so nothing is reused from earlier loads.
+void Bench::loadMap() {
+    QString map_name = generator->getMapName(1);
+    QBENCHMARK {
+        Project fresh;
+        fresh.root = dir.path();
+        fresh.loadMap(map_name);
+    }
+}
+
+// Only the labels are taken from the cached tileset. The assets are loaded fresh and freed each time.
+void Bench::loadTilesetAssets() {
+    QBENCHMARK {
+        Tileset tileset = *map->tileset_primary;
+        tileset.tiles = NULL;
+        tileset.metatiles = NULL;
+        tileset.palettes = NULL;
+        project->loadTilesetAssets(&tileset);
+        Project::deleteTilesetContents(&tileset);
+    }
+}
+
+void Bench::render() {
+    QBENCHMARK {
+        map->clearRenderCache();
+        map->render();
+    }
+}
+
+void Bench::renderCollision() {
+    QBENCHMARK {
+        map->clearRenderCache();
+        map->renderCollision();
+    }
+}
+
+// Every fill covers the whole map.
+void Bench::floodFill() {
+    for (int i = 0; i < map->blockdata->length(); i++) {
+        Block block = map->blockdata->block(i);
+        block.tile = 1;
+        map->blockdata->setBlock(i, block);
+    }
+    uint tile = 1;
+    QBENCHMARK {
+        tile ^= 1;
+        map->_floodFill(0, 0, tile);
+    }
+}
+
+void Bench::serializeBlockdata() {
+    QByteArray data;
+    QBENCHMARK {
+        data = map->blockdata->serialize();
+    }
+    QCOMPARE(data.length(), options.map_width * options.map_height * 2);
+}
+
+int main(int argc, char *argv[])
+{
+    // Benchmarks don't need a screen.
+    if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+    QGuiApplication app(argc, argv);
+
+    // Default to csv, so results can be diffed between commits.
+    QStringList args = app.arguments();
+    QStringList formats = {"-o", "-txt", "-csv", "-xml", "-xunitxml", "-lightxml", "-teamcity", "-tap"};
+    bool has_format = false;
+    for (QString arg : args) {
+        if (formats.contains(arg)) {
+            has_format = true;
+        }
+    }
+    if (!has_format) {
+        args << "-csv";
+    }
+
+    Bench bench;
+    return QTest::qExec(&bench, args);
+}
+
+#include "bench.moc"
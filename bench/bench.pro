@@ -0,0 +1,50 @@
+#-------------------------------------------------
+#
+# Benchmarks for the hot paths of pretmap.
+# Build and run with: qmake && make && ./pretmap_bench
+#
+#-------------------------------------------------
+
+QT       += core gui concurrent testlib
+
+greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
+
+TARGET = pretmap_bench
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+INCLUDEPATH += .. ../tools/generator
+
+SOURCES += bench.cpp \
+    ../tools/generator/projectgenerator.cpp \
+    ../project.cpp \
+    ../asm.cpp \
+    ../map.cpp \
+    ../blockdata.cpp \
+    ../blockdelta.cpp \
+    ../block.cpp \
+    ../tileset.cpp \
+    ../metatile.cpp \
+    ../tile.cpp \
+    ../event.cpp \
+    ../projectcache.cpp \
+    ../trace.cpp \
+    ../cfile.cpp \
+    ../constants.cpp
+
+HEADERS  += ../tools/generator/projectgenerator.h \
+    ../project.h \
+    ../asm.h \
+    ../map.h \
+    ../blockdata.h \
+    ../blockdelta.h \
+    ../block.h \
+    ../tileset.h \
+    ../metatile.h \
+    ../tile.h \
+    ../event.h \
+    ../projectcache.h \
+    ../trace.h \
+    ../cfile.h \
+    ../constants.h
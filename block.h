@@ -3,18 +3,33 @@
 
 #include <QObject>
 
+// One block of a map, unpacked for editing.
+// Blockdata keeps them packed into a word each, as map.bin does:
+// bits 0-9 are the metatile, 10-11 the collision and 12-15 the elevation.
 class Block
 {
 public:
     Block();
     Block(uint16_t);
-    Block(const Block&);
     bool operator ==(Block);
     bool operator !=(Block);
     uint16_t tile:10;
     uint16_t collision:2;
     uint16_t elevation:4;
-    uint16_t rawValue();
+    uint16_t rawValue() const;
+
+    static constexpr uint16_t tileOf(uint16_t word) {
+        return word & 0x3ff;
+    }
+    static constexpr uint16_t collisionOf(uint16_t word) {
+        return (word >> 10) & 0x3;
+    }
+    static constexpr uint16_t elevationOf(uint16_t word) {
+        return (word >> 12) & 0xf;
+    }
+    static constexpr uint16_t pack(uint16_t tile, uint16_t collision, uint16_t elevation) {
+        return (tile & 0x3ff) | ((collision & 0x3) << 10) | ((elevation & 0xf) << 12);
+    }
 };
 
 #endif // BLOCK_H
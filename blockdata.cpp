@@ -1,36 +1,131 @@
 #include "blockdata.h"
 #include <QDebug>
+#include <QtAlgorithms>
+#include <cstring>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define BLOCKDATA_SSE2
+#endif
+
+// The first index from start where a and b differ (or match, if equal is set), or length if there isn't one.
+// Compares 16 or 8 words at a time where the compiler targets AVX2 or SSE2.
+static int findMismatch(const uint16_t *a, const uint16_t *b, int start, int length, bool equal) {
+    int i = start;
+#if defined(__AVX2__)
+    for (; i + 16 <= length; i += 16) {
+        __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i));
+        __m256i y = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i));
+        // Two bits per word.
+        uint mask = uint(_mm256_movemask_epi8(_mm256_cmpeq_epi16(x, y)));
+        if (!equal) {
+            mask = ~mask;
+        }
+        if (mask) {
+            return i + qCountTrailingZeroBits(mask) / 2;
+        }
+    }
+#endif
+#if defined(BLOCKDATA_SSE2)
+    for (; i + 8 <= length; i += 8) {
+        __m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i y = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        uint mask = uint(_mm_movemask_epi8(_mm_cmpeq_epi16(x, y)));
+        if (!equal) {
+            mask = ~mask & 0xffff;
+        }
+        if (mask) {
+            return i + qCountTrailingZeroBits(mask) / 2;
+        }
+    }
+#endif
+    for (; i < length; i++) {
+        if ((a[i] == b[i]) == equal) {
+            return i;
+        }
+    }
+    return length;
+}
 
 Blockdata::Blockdata(QObject *parent) : QObject(parent)
 {
-    blocks = new QList<Block>;
+}
+
+QVector<uint16_t> Blockdata::toVector() const {
+    return blocks;
 }
 
 void Blockdata::addBlock(uint16_t word) {
-    Block block(word);
-    blocks->append(block);
+    blocks.append(word);
+}
+
+// New blocks are zero.
+void Blockdata::resize(int length) {
+    blocks.resize(length);
 }
 
 void Blockdata::addBlock(Block block) {
-    blocks->append(block);
+    addBlock(block.rawValue());
 }
 
 QByteArray Blockdata::serialize() {
-    QByteArray data;
-    for (int i = 0; i < blocks->length(); i++) {
-        Block block = blocks->value(i);
-        uint16_t word = block.rawValue();
-        data.append(word & 0xff);
-        data.append((word >> 8) & 0xff);
+    return serialize(constData(), length());
+}
+
+QByteArray Blockdata::serialize(const QVector<uint16_t> &blocks) {
+    return serialize(blocks.constData(), blocks.length());
+}
+
+QByteArray Blockdata::serialize(const uint16_t *words, int length) {
+    QByteArray data(length * 2, Qt::Uninitialized);
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    memcpy(data.data(), words, data.length());
+#else
+    for (int i = 0; i < length; i++) {
+        uint16_t word = words[i];
+        data[i * 2] = word & 0xff;
+        data[i * 2 + 1] = (word >> 8) & 0xff;
     }
+#endif
     return data;
 }
 
-void Blockdata::copyFrom(Blockdata* other) {
-    blocks->clear();
-    for (int i = 0; i < other->blocks->length(); i++) {
-        addBlock(other->blocks->value(i));
+// A trailing odd byte is ignored.
+void Blockdata::deserialize(const QByteArray &data) {
+    int length = data.length() / 2;
+    blocks.resize(length);
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    memcpy(blocks.data(), data.constData(), length * 2);
+#else
+    for (int i = 0; i < length; i++) {
+        blocks[i] = (data[i * 2] & 0xff) + ((data[i * 2 + 1] & 0xff) << 8);
+    }
+#endif
+}
+
+// Reads the rest of the device straight into the array, without a buffer in between.
+// Returns false if fewer bytes came back than the device said it had, keeping the blocks that did.
+bool Blockdata::read(QIODevice *device) {
+#if Q_BYTE_ORDER == Q_LITTLE_ENDIAN
+    int length = device->bytesAvailable() / 2;
+    blocks.resize(length);
+    qint64 size = device->read(reinterpret_cast<char*>(blocks.data()), length * 2);
+    if (size < length * 2) {
+        blocks.resize(qMax(size, (qint64)0) / 2);
+        return false;
     }
+    return true;
+#else
+    deserialize(device->readAll());
+    return true;
+#endif
+}
+
+void Blockdata::copyFrom(Blockdata* other) {
+    blocks = other->blocks;
 }
 
 Blockdata* Blockdata::copy() {
@@ -43,13 +138,44 @@ bool Blockdata::equals(Blockdata *other) {
     if (!other) {
         return false;
     }
-    if (blocks->length() != other->blocks->length()) {
+    if (length() != other->length()) {
         return false;
     }
-    for (int i = 0; i < blocks->length(); i++) {
-        if (blocks->value(i) != other->blocks->value(i)) {
-            return false;
+    if (constData() == other->constData()) {
+        return true;
+    }
+    return findMismatch(constData(), other->constData(), 0, length(), false) == length();
+}
+
+// The runs of blocks in current that differ from cached, in order.
+// Blocks past the end of cached, or everything if there's no cache, count as changed.
+QVector<BlockRange> Blockdata::diff(const Blockdata *current, const Blockdata *cached) {
+    QVector<BlockRange> ranges;
+    if (!current || !current->length()) {
+        return ranges;
+    }
+    int length = current->length();
+    if (!cached) {
+        ranges.append(BlockRange(0, length));
+        return ranges;
+    }
+    int common = qMin(length, cached->length());
+    const uint16_t *a = current->constData();
+    const uint16_t *b = cached->constData();
+    if (a != b) {
+        int i = findMismatch(a, b, 0, common, false);
+        while (i < common) {
+            int end = findMismatch(a, b, i, common, true);
+            ranges.append(BlockRange(i, end));
+            i = findMismatch(a, b, end, common, false);
         }
     }
-    return true;
+    if (common < length) {
+        if (!ranges.isEmpty() && ranges.last().second == common) {
+            ranges.last().second = length;
+        } else {
+            ranges.append(BlockRange(common, length));
+        }
+    }
+    return ranges;
 }
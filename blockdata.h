@@ -5,7 +5,15 @@
 
 #include <QObject>
 #include <QByteArray>
+#include <QVector>
+#include <QIODevice>
+#include <QPair>
 
+// A run of block indices, [first, second).
+typedef QPair<int, int> BlockRange;
+
+// The blocks are stored as one contiguous array of packed words, the same layout as map.bin.
+// Copies share the array until one of them is changed.
 class Blockdata : public QObject
 {
     Q_OBJECT
@@ -13,13 +21,40 @@ public:
     explicit Blockdata(QObject *parent = 0);
 
 public:
-    QList<Block> *blocks = NULL;
+    int length() const {
+        return blocks.length();
+    }
+    uint16_t word(int i) const {
+        return blocks.at(i);
+    }
+    Block block(int i) const {
+        return Block(word(i));
+    }
+    void setBlock(int i, Block block) {
+        setWord(i, block.rawValue());
+    }
+    void setWord(int i, uint16_t word) {
+        blocks[i] = word;
+    }
+    void resize(int length);
+    const uint16_t *constData() const {
+        return blocks.constData();
+    }
+    QVector<uint16_t> toVector() const;
     void addBlock(uint16_t);
     void addBlock(Block);
     QByteArray serialize();
+    static QByteArray serialize(const QVector<uint16_t> &blocks);
+    static QByteArray serialize(const uint16_t *words, int length);
+    void deserialize(const QByteArray &data);
+    bool read(QIODevice *device);
     void copyFrom(Blockdata*);
     Blockdata* copy();
     bool equals(Blockdata *);
+    static QVector<BlockRange> diff(const Blockdata *current, const Blockdata *cached);
+
+private:
+    QVector<uint16_t> blocks;
 
 signals:
 
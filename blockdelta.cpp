@@ -0,0 +1,138 @@
+#include "blockdelta.h"
+
+// Pairs of (count, word). Returns false, and leaves encoded alone, if that isn't any smaller.
+static bool encodeRuns(const QVector<uint16_t> &words, QVector<uint16_t> *encoded) {
+    QVector<uint16_t> runs;
+    for (int i = 0; i < words.length();) {
+        uint16_t word = words.at(i);
+        int count = 1;
+        while (i + count < words.length() && words.at(i + count) == word && count < 0xffff) {
+            count++;
+        }
+        runs.append(count);
+        runs.append(word);
+        if (runs.length() >= words.length()) {
+            return false;
+        }
+        i += count;
+    }
+    *encoded = runs;
+    return true;
+}
+
+BlockDelta::BlockDelta()
+{
+}
+
+// Returns an empty delta if nothing changed.
+BlockDelta* BlockDelta::diff(const Blockdata *before, const Blockdata *after) {
+    BlockDelta *delta = new BlockDelta;
+    delta->old_length = before->length();
+    delta->new_length = after->length();
+    if (delta->old_length == delta->new_length) {
+        delta->ranges = Blockdata::diff(after, before);
+    } else if (delta->old_length || delta->new_length) {
+        // Resizes are rare. Keep all of it, and fill the side that's short with zeroes.
+        delta->ranges.append(BlockRange(0, qMax(delta->old_length, delta->new_length)));
+    }
+
+    QVector<uint16_t> old_words;
+    QVector<uint16_t> new_words;
+    for (BlockRange range : delta->ranges) {
+        for (int i = range.first; i < range.second; i++) {
+            old_words.append(i < delta->old_length ? before->word(i) : 0);
+            new_words.append(i < delta->new_length ? after->word(i) : 0);
+        }
+    }
+    delta->old_encoded = encodeRuns(old_words, &delta->old_words);
+    if (!delta->old_encoded) {
+        delta->old_words = old_words;
+    }
+    delta->new_encoded = encodeRuns(new_words, &delta->new_words);
+    if (!delta->new_encoded) {
+        delta->new_words = new_words;
+    }
+    return delta;
+}
+
+void BlockDelta::undo(Blockdata *blockdata) {
+    decompress();
+    apply(blockdata, old_length, old_words, old_encoded);
+}
+
+void BlockDelta::redo(Blockdata *blockdata) {
+    decompress();
+    apply(blockdata, new_length, new_words, new_encoded);
+}
+
+void BlockDelta::apply(Blockdata *blockdata, int length, const QVector<uint16_t> &words, bool encoded) const {
+    if (blockdata->length() != length) {
+        blockdata->resize(length);
+    }
+    // Where we are in words, and how many more times the current word repeats if encoded.
+    int pos = 0;
+    int repeat = 0;
+    uint16_t word = 0;
+    for (BlockRange range : ranges) {
+        for (int i = range.first; i < range.second; i++) {
+            if (encoded) {
+                if (!repeat) {
+                    repeat = words.at(pos);
+                    word = words.at(pos + 1);
+                    pos += 2;
+                }
+                repeat--;
+            } else {
+                word = words.at(pos++);
+            }
+            if (i < length) {
+                blockdata->setWord(i, word);
+            }
+        }
+    }
+}
+
+bool BlockDelta::isEmpty() const {
+    return ranges.isEmpty() && old_length == new_length;
+}
+
+qint64 BlockDelta::memoryUsage() const {
+    return sizeof(BlockDelta)
+        + ranges.length() * sizeof(BlockRange)
+        + (old_words.length() + new_words.length()) * sizeof(uint16_t)
+        + compressed.size();
+}
+
+// Kept as is if it wouldn't get any smaller, which is typical of small edits.
+void BlockDelta::compress() {
+    if (!compressed.isNull() || compress_tried || old_words.isEmpty()) {
+        return;
+    }
+    QByteArray words = Blockdata::serialize(old_words) + Blockdata::serialize(new_words);
+    QByteArray deflated = qCompress(words, 1);
+    if (deflated.size() >= words.size()) {
+        compress_tried = true;
+        return;
+    }
+    compressed = deflated;
+    old_count = old_words.length();
+    new_count = new_words.length();
+    old_words.clear();
+    old_words.squeeze();
+    new_words.clear();
+    new_words.squeeze();
+}
+
+// Undo and redo call this. The history compresses it again once it's far enough back.
+void BlockDelta::decompress() {
+    if (compressed.isNull()) {
+        return;
+    }
+    QByteArray words = qUncompress(compressed);
+    Blockdata blockdata;
+    blockdata.deserialize(words.left(old_count * 2));
+    old_words = blockdata.toVector();
+    blockdata.deserialize(words.mid(old_count * 2, new_count * 2));
+    new_words = blockdata.toVector();
+    compressed = QByteArray();
+}
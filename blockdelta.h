@@ -0,0 +1,44 @@
+#ifndef BLOCKDELTA_H
+#define BLOCKDELTA_H
+
+#include "blockdata.h"
+
+#include <QVector>
+#include <QByteArray>
+
+// One commit to a map's blocks: the runs of blocks it changed, with their words before and after.
+// Undoing or redoing it only touches those blocks, so it costs as much as the edit, not the map.
+class BlockDelta
+{
+public:
+    BlockDelta();
+    static BlockDelta* diff(const Blockdata *before, const Blockdata *after);
+    void undo(Blockdata *blockdata);
+    void redo(Blockdata *blockdata);
+    bool isEmpty() const;
+    qint64 memoryUsage() const;
+    void compress();
+    void decompress();
+
+public:
+    int old_length = 0;
+    int new_length = 0;
+    QVector<BlockRange> ranges;
+    // The words in ranges, one range after another.
+    // Fills tend to repeat the same word, so these are run-length encoded when that makes them smaller.
+    QVector<uint16_t> old_words;
+    QVector<uint16_t> new_words;
+    bool old_encoded = false;
+    bool new_encoded = false;
+    // old_words then new_words, deflated. The vectors are empty while this is set.
+    QByteArray compressed;
+    // Set once deflating didn't help, so it isn't tried again on every push.
+    bool compress_tried = false;
+    int old_count = 0;
+    int new_count = 0;
+
+private:
+    void apply(Blockdata *blockdata, int length, const QVector<uint16_t> &words, bool encoded) const;
+};
+
+#endif // BLOCKDELTA_H
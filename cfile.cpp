@@ -0,0 +1,139 @@
+#include "cfile.h"
+
+static bool isIdentifierStart(char c) {
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || c == '_';
+}
+
+static bool isIdentifierChar(char c) {
+    return isIdentifierStart(c) || (c >= '0' && c <= '9');
+}
+
+static bool isSpace(char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\f' || c == '\v';
+}
+
+CFile::CFile()
+{
+}
+
+CFile::CFile(const QByteArray &text_)
+{
+    parse(text_);
+}
+
+// Looks for definitions of the form
+//     label[] = { a, b, c };
+//     label = { a, b, c };
+//     label[] = INCBIN_U32("path");
+// Nested braces are not followed; the initializer ends at the first '}'.
+// Only the first definition of a label is used.
+void CFile::parse(const QByteArray &text_) {
+    text = text_;
+    arrays.clear();
+    incbins.clear();
+
+    const char *pos = text.constData();
+    const char *end = pos + text.length();
+    while (pos < end) {
+        char c = *pos;
+        if (c == '/' && pos + 1 < end && pos[1] == '/') {
+            while (pos < end && *pos != '\n') pos++;
+            continue;
+        }
+        if (c == '/' && pos + 1 < end && pos[1] == '*') {
+            pos += 2;
+            while (pos + 1 < end && !(pos[0] == '*' && pos[1] == '/')) pos++;
+            pos += 2;
+            continue;
+        }
+        if (c == '"' || c == '\'') {
+            pos++;
+            while (pos < end && *pos != c) {
+                if (*pos == '\\') pos++;
+                pos++;
+            }
+            pos++;
+            continue;
+        }
+        if (!isIdentifierStart(c)) {
+            pos++;
+            continue;
+        }
+
+        const char *label_start = pos;
+        while (pos < end && isIdentifierChar(*pos)) pos++;
+        QString label = QString::fromLatin1(label_start, pos - label_start);
+
+        const char *p = pos;
+        while (p < end && isSpace(*p)) p++;
+        if (p < end && *p == '[') {
+            p++;
+            while (p < end && isSpace(*p)) p++;
+            if (p >= end || *p != ']') {
+                continue;
+            }
+            p++;
+            while (p < end && isSpace(*p)) p++;
+        }
+        if (p >= end || *p != '=' || (p + 1 < end && p[1] == '=')) {
+            continue;
+        }
+        p++;
+        while (p < end && isSpace(*p)) p++;
+        if (p >= end) {
+            break;
+        }
+
+        if (*p == '{') {
+            const char *body_start = ++p;
+            while (p < end && *p != '}') p++;
+            if (p >= end) {
+                break;
+            }
+            if (!arrays.contains(label)) {
+                QByteArray body;
+                body.reserve(p - body_start);
+                for (const char *b = body_start; b < p; b++) {
+                    if (!isSpace(*b)) {
+                        body.append(*b);
+                    }
+                }
+                arrays.insert(label, QString::fromUtf8(body).split(','));
+            }
+            pos = p + 1;
+        } else if (isIdentifierStart(*p)) {
+            const char *macro_start = p;
+            while (p < end && isIdentifierChar(*p)) p++;
+            QByteArray macro(macro_start, p - macro_start);
+            if (!macro.startsWith("INCBIN_")) {
+                continue;
+            }
+            while (p < end && isSpace(*p)) p++;
+            if (p >= end || *p != '(') {
+                continue;
+            }
+            p++;
+            while (p < end && isSpace(*p)) p++;
+            if (p >= end || *p != '"') {
+                continue;
+            }
+            const char *path_start = ++p;
+            while (p < end && *p != '"') p++;
+            if (p >= end) {
+                break;
+            }
+            if (!incbins.contains(label)) {
+                incbins.insert(label, QString::fromUtf8(path_start, p - path_start));
+            }
+            pos = p + 1;
+        }
+    }
+}
+
+QStringList CFile::getArray(QString label) {
+    return arrays.value(label);
+}
+
+QString CFile::getIncbin(QString label) {
+    return incbins.value(label);
+}
@@ -0,0 +1,31 @@
+#ifndef CFILE_H
+#define CFILE_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QHash>
+#include <QDateTime>
+
+// The symbols defined in a C source file, found in one pass:
+// array and struct initializers, and INCBIN paths.
+class CFile
+{
+public:
+    CFile();
+    explicit CFile(const QByteArray &text_);
+    void parse(const QByteArray &text_);
+    QStringList getArray(QString label);
+    QString getIncbin(QString label);
+
+public:
+    QString path;
+    QDateTime modified;
+    QByteArray text;
+    // label -> initializer elements, with whitespace removed.
+    QHash<QString, QStringList> arrays;
+    // label -> path given to INCBIN_*.
+    QHash<QString, QString> incbins;
+};
+
+#endif // CFILE_H
@@ -0,0 +1,58 @@
+#include "constants.h"
+
+Constants::Constants()
+{
+}
+
+Constants::Constants(const QList<QStringList> &commands)
+{
+    parse(commands);
+}
+
+void Constants::parse(const QList<QStringList> &commands) {
+    names.clear();
+    values.clear();
+    names_by_value.clear();
+    for (const QStringList &params : commands) {
+        QString macro = params.value(0);
+        if (macro != ".set" && macro != ".equiv") {
+            continue;
+        }
+        QString name = params.value(1);
+        if (name.isEmpty()) {
+            continue;
+        }
+        bool ok = false;
+        int value = params.value(2).toInt(&ok, 0);
+        if (!values.contains(name)) {
+            names.append(name);
+        }
+        // .set can redefine a symbol. The last definition wins, as it would for the assembler.
+        values.insert(name, value);
+        if (ok && !names_by_value.contains(value)) {
+            names_by_value.insert(value, name);
+        }
+    }
+}
+
+bool Constants::contains(QString name) const {
+    return values.contains(name);
+}
+
+int Constants::value(QString name, int default_value) const {
+    return values.value(name, default_value);
+}
+
+QString Constants::name(int value) const {
+    return names_by_value.value(value);
+}
+
+QStringList Constants::namesWithPrefix(QString prefix) const {
+    QStringList matches;
+    for (QString name : names) {
+        if (name.startsWith(prefix)) {
+            matches.append(name);
+        }
+    }
+    return matches;
+}
@@ -0,0 +1,33 @@
+#ifndef CONSTANTS_H
+#define CONSTANTS_H
+
+#include "asm.h"
+
+#include <QString>
+#include <QStringList>
+#include <QList>
+#include <QHash>
+#include <QSharedPointer>
+
+// The symbols a constants file defines with .set or .equiv,
+// indexed both ways so lookups don't have to walk the file.
+class Constants
+{
+public:
+    Constants();
+    explicit Constants(const QList<QStringList> &commands);
+    void parse(const QList<QStringList> &commands);
+    bool contains(QString name) const;
+    int value(QString name, int default_value = 0) const;
+    QString name(int value) const;
+    QStringList namesWithPrefix(QString prefix) const;
+
+public:
+    // The file these were read from. A different pointer means it changed on disk.
+    QSharedPointer<AsmFile> source;
+    QStringList names; // In the order they were defined.
+    QHash<QString, int> values;
+    QHash<int, QString> names_by_value; // The first name defined for each value.
+};
+
+#endif // CONSTANTS_H
@@ -1,4 +1,5 @@
 #include "editor.h"
+#include "trace.h"
 #include <QPainter>
 #include <QMouseEvent>
 
@@ -7,18 +8,6 @@ Editor::Editor()
     selected_events = new QList<DraggablePixmapItem*>;
 }
 
-void Editor::saveProject() {
-    if (project) {
-        project->saveAllMaps();
-    }
-}
-
-void Editor::save() {
-    if (project && map) {
-        project->saveMap(map);
-    }
-}
-
 void Editor::undo() {
     if (current_view) {
         ((MapPixmapItem*)current_view)->undo();
@@ -79,7 +68,13 @@ void Editor::setMap(QString map_name) {
         return;
     }
     if (project) {
-        map = project->loadMap(map_name);
+        setMap(project->loadMap(map_name));
+    }
+}
+
+void Editor::setMap(Map *map_) {
+    if (project && map_) {
+        map = map_;
         displayMap();
         selected_events->clear();
         updateSelectedObjects();
@@ -110,6 +105,12 @@ void Editor::mouseEvent_collision(QGraphicsSceneMouseEvent *event, CollisionPixm
 }
 
 void Editor::displayMap() {
+    TRACE_SCOPE("Editor::displayMap");
+    TRACE_ARG("map", map->name);
+    // The old scenes take their items with them.
+    if (scene) {
+        scene->deleteLater();
+    }
     scene = new QGraphicsScene;
 
     map_item = new MapPixmapItem(map);
@@ -157,6 +158,9 @@ void Editor::displayMap() {
 }
 
 void Editor::displayMetatiles() {
+    if (scene_metatiles) {
+        scene_metatiles->deleteLater();
+    }
     scene_metatiles = new QGraphicsScene;
     metatiles_item = new MetatilesPixmapItem(map);
     metatiles_item->draw();
@@ -164,6 +168,9 @@ void Editor::displayMetatiles() {
 }
 
 void Editor::displayCollisionMetatiles() {
+    if (scene_collision_metatiles) {
+        scene_collision_metatiles->deleteLater();
+    }
     scene_collision_metatiles = new QGraphicsScene;
     collision_metatiles_item = new CollisionMetatilesPixmapItem(map);
     collision_metatiles_item->draw();
@@ -171,6 +178,9 @@ void Editor::displayCollisionMetatiles() {
 }
 
 void Editor::displayElevationMetatiles() {
+    if (scene_elevation_metatiles) {
+        scene_elevation_metatiles->deleteLater();
+    }
     scene_elevation_metatiles = new QGraphicsScene;
     elevation_metatiles_item = new ElevationMetatilesPixmapItem(map);
     elevation_metatiles_item->draw();
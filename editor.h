@@ -25,11 +25,10 @@ public:
     QObject *parent = NULL;
     Project *project = NULL;
     Map *map = NULL;
-    void saveProject();
-    void save();
     void undo();
     void redo();
     void setMap(QString map_name);
+    void setMap(Map *map_);
     void displayMap();
     void displayMetatiles();
     void displayCollisionMetatiles();
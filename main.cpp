@@ -1,11 +1,51 @@
 #include "mainwindow.h"
+#include "migrator.h"
+#include "trace.h"
 #include <QApplication>
+#include <QGuiApplication>
+#include <cstdio>
 
 int main(int argc, char *argv[])
 {
+    // PRETMAP_TRACE=<path> or --trace <path> writes a Chrome trace on exit.
+    QString trace_path = QString::fromLocal8Bit(qgetenv("PRETMAP_TRACE"));
+    QString migrate_root;
+    for (int i = 1; i < argc; i++) {
+        QString arg(argv[i]);
+        // pretmap --migrate <root> loads and re-saves every map, then exits.
+        if (arg != "--trace" && arg != "--migrate") {
+            continue;
+        }
+        if (i + 1 >= argc) {
+            fprintf(stderr, "usage: pretmap [--trace <path>] [--migrate <project root>]\n");
+            return 2;
+        }
+        QString value = QString::fromLocal8Bit(argv[++i]);
+        if (arg == "--trace") {
+            trace_path = value;
+        } else {
+            migrate_root = value;
+        }
+    }
+    Trace::start(trace_path);
+
+    if (!migrate_root.isNull()) {
+        // Events hold pixmaps, so this still needs a gui application, just not a screen.
+        if (qEnvironmentVariableIsEmpty("QT_QPA_PLATFORM")) {
+            qputenv("QT_QPA_PLATFORM", "offscreen");
+        }
+        QGuiApplication a(argc, argv);
+        Migrator migrator(migrate_root);
+        int result = migrator.run();
+        Trace::finish();
+        return result;
+    }
+
     QApplication a(argc, argv);
     MainWindow w;
     w.show();
 
-    return a.exec();
+    int result = a.exec();
+    Trace::finish();
+    return result;
 }
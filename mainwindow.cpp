@@ -30,9 +30,25 @@ MainWindow::MainWindow(QWidget *parent) :
     connect(editor, SIGNAL(objectsChanged()), this, SLOT(updateSelectedObjects()));
     connect(editor, SIGNAL(selectedObjectsChanged()), this, SLOT(updateSelectedObjects()));
 
+    map_loader = new MapLoader(this);
+    connect(map_loader, SIGNAL(loaded(Map*)), this, SLOT(onMapLoaded(Map*)));
+    connect(map_loader, SIGNAL(progress(QString,QString,int,int)), this, SLOT(onMapLoadProgress(QString,QString,int,int)));
+    connect(map_loader, SIGNAL(canceled(QString)), this, SLOT(onMapLoadCanceled(QString)));
+    connect(map_loader, SIGNAL(preloaded(Project*,int,int,qint64,qint64)), this, SLOT(onProjectPreloaded(Project*,int,int,qint64,qint64)));
+
+    map_saver = new MapSaver(this);
+    connect(map_saver, SIGNAL(saved(QString,bool)), this, SLOT(onMapSaved(QString,bool)));
+    connect(map_saver, SIGNAL(saveFailed(QString)), this, SLOT(onMapSaveFailed(QString)));
+
+    source_watcher = new SourceWatcher(this);
+    connect(source_watcher, SIGNAL(mapReloaded(Map*)), this, SLOT(onMapReloaded(Map*)));
+    connect(source_watcher, SIGNAL(tilesetReloaded(Tileset*)), this, SLOT(onTilesetReloaded(Tileset*)));
+
     on_toolButton_Paint_clicked();
 
     QSettings settings;
+    ui->actionPreload_Project->setChecked(settings.value("preload_project", false).toBool());
+
     QString key = "recent_projects";
     if (settings.contains(key)) {
         QString default_dir = settings.value(key).toStringList().last();
@@ -45,6 +61,10 @@ MainWindow::MainWindow(QWidget *parent) :
 
 MainWindow::~MainWindow()
 {
+    map_saver->waitForFinished();
+    if (editor && editor->project) {
+        editor->project->saveProjectCache();
+    }
     delete ui;
 }
 
@@ -58,11 +78,24 @@ void MainWindow::openProject(QString dir) {
         && (editor->project->root == dir)
     );
     if (!already_open) {
+        map_loader->cancel();
+        map_loader->cancelPreload();
+        map_saver->waitForFinished();
+        if (editor->project) {
+            editor->project->saveProjectCache();
+        }
         editor->project = new Project;
         editor->project->root = dir;
+        editor->project->loadProjectCache();
+        editor->project->memory_budget = QSettings().value("cache_budget_mb", 1024).toLongLong() * 1024 * 1024;
+        editor->project->history_budget = QSettings().value("undo_budget_mb", 32).toLongLong() * 1024 * 1024;
+        source_watcher->setProject(editor->project);
         setWindowTitle(editor->project->getProjectTitle() + " - pretmap");
         populateMapList();
         setMap(getDefaultMap());
+        if (ui->actionPreload_Project->isChecked()) {
+            preloadProject();
+        }
     } else {
         setWindowTitle(editor->project->getProjectTitle() + " - pretmap");
         populateMapList();
@@ -129,7 +162,67 @@ void MainWindow::setMap(QString map_name) {
     if (map_name.isNull()) {
         return;
     }
-    editor->setMap(map_name);
+    if (editor->project->map_cache->contains(map_name)) {
+        map_loader->cancel();
+        onMapLoaded(editor->project->getMap(map_name));
+        return;
+    }
+    // Loading happens off the ui thread. A newer selection cancels this one.
+    map_loader->load(editor->project, map_name);
+}
+
+void MainWindow::preloadProject() {
+    if (editor && editor->project) {
+        ui->statusBar->showMessage(QString("Preloading %1...").arg(editor->project->getProjectTitle()));
+        map_loader->preload(editor->project);
+    }
+}
+
+void MainWindow::on_actionPreload_Project_triggered(bool checked) {
+    QSettings settings;
+    settings.setValue("preload_project", checked);
+    if (checked) {
+        preloadProject();
+    }
+}
+
+void MainWindow::onProjectPreloaded(Project *project, int num_maps, int num_tilesets, qint64 msecs, qint64 peak_memory) {
+    if (project != editor->project) {
+        // Another project was opened since.
+        return;
+    }
+    QString message = QString("Preloaded %1 maps and %2 tilesets in %3 ms").arg(num_maps).arg(num_tilesets).arg(msecs);
+    if (peak_memory >= 0) {
+        message += QString(" (peak memory %1 MB)").arg(peak_memory / (1024 * 1024));
+    }
+    qDebug() << message;
+    ui->statusBar->showMessage(message);
+    editor->project->saveProjectCache();
+    source_watcher->watchCache();
+    updateMapList();
+}
+
+void MainWindow::onMapLoadProgress(QString map_name, QString stage, int step, int total) {
+    ui->statusBar->showMessage(QString("Loading %1: %2 (%3/%4)").arg(map_name).arg(stage).arg(step).arg(total));
+}
+
+void MainWindow::onMapLoadCanceled(QString map_name) {
+    qDebug() << QString("Canceled loading %1").arg(map_name);
+}
+
+void MainWindow::onMapLoaded(Map *map) {
+    ui->statusBar->clearMessage();
+    QString map_name = map->name;
+
+    // Keep what's on screen cached, including the connected maps it's about to load.
+    QStringList pinned;
+    pinned << map_name;
+    for (Connection *connection : map->connections) {
+        pinned << connection->map_name;
+    }
+    editor->project->pinned_maps = pinned;
+
+    editor->setMap(map);
 
     if (ui->tabWidget->currentIndex() == 1) {
         editor->setEditingObjects();
@@ -166,10 +259,49 @@ void MainWindow::setMap(QString map_name) {
 
     setWindowTitle(map_name + " - " + editor->project->getProjectTitle() + " - pretmap");
 
-    connect(editor->map, SIGNAL(mapChanged(Map*)), this, SLOT(onMapChanged(Map *)));
+    connect(editor->map, SIGNAL(mapChanged(Map*)), this, SLOT(onMapChanged(Map *)), Qt::UniqueConnection);
 
     setRecentMap(map_name);
     updateMapList();
+
+    // Connected maps are loaded along with it.
+    source_watcher->watchCache();
+}
+
+// Only redraw if it's something on screen.
+void MainWindow::onMapReloaded(Map *map) {
+    Map *current = editor->map;
+    if (!current) {
+        return;
+    }
+    bool visible = (map == current);
+    for (Connection *connection : current->connections) {
+        if (connection->map_name == map->name) {
+            visible = true;
+        }
+    }
+    if (visible) {
+        onMapLoaded(current);
+        ui->statusBar->showMessage(QString("Reloaded %1").arg(map->name));
+    }
+}
+
+void MainWindow::onTilesetReloaded(Tileset *tileset) {
+    Map *current = editor->map;
+    if (!current) {
+        return;
+    }
+    bool visible = (current->tileset_primary == tileset || current->tileset_secondary == tileset);
+    for (Connection *connection : current->connections) {
+        Map *connected = editor->project->map_cache->value(connection->map_name, NULL);
+        if (connected && (connected->tileset_primary == tileset || connected->tileset_secondary == tileset)) {
+            visible = true;
+        }
+    }
+    if (visible) {
+        onMapLoaded(current);
+        ui->statusBar->showMessage(QString("Reloaded tileset %1").arg(tileset->name));
+    }
 }
 
 void MainWindow::setRecentMap(QString map_name) {
@@ -380,8 +512,9 @@ void MainWindow::updateMapList() {
 
 void MainWindow::on_action_Save_Project_triggered()
 {
-    editor->saveProject();
-    updateMapList();
+    if (editor->project) {
+        map_saver->saveAll(editor->project);
+    }
 }
 
 void MainWindow::undo() {
@@ -393,8 +526,21 @@ void MainWindow::redo() {
 }
 
 void MainWindow::on_action_Save_triggered() {
-    editor->save();
+    if (editor->project && editor->map) {
+        map_saver->save(editor->project, editor->map);
+    }
+}
+
+void MainWindow::onMapSaved(QString map_name, bool written) {
+    updateMapList();
+    if (written) {
+        ui->statusBar->showMessage(QString("Saved %1").arg(map_name));
+    }
+}
+
+void MainWindow::onMapSaveFailed(QString map_name) {
     updateMapList();
+    ui->statusBar->showMessage(QString("Failed to save %1").arg(map_name));
 }
 
 void MainWindow::on_tabWidget_2_currentChanged(int index)
@@ -11,6 +11,9 @@
 #include "project.h"
 #include "map.h"
 #include "editor.h"
+#include "maploader.h"
+#include "mapsaver.h"
+#include "sourcewatcher.h"
 
 namespace Ui {
 class MainWindow;
@@ -33,6 +36,16 @@ private slots:
     void redo();
 
     void onMapChanged(Map *map);
+    void onMapLoaded(Map *map);
+    void onMapLoadProgress(QString map_name, QString stage, int step, int total);
+    void onMapLoadCanceled(QString map_name);
+    void onProjectPreloaded(Project *project, int num_maps, int num_tilesets, qint64 msecs, qint64 peak_memory);
+    void on_actionPreload_Project_triggered(bool checked);
+    void onMapReloaded(Map *map);
+    void onTilesetReloaded(Tileset *tileset);
+
+    void onMapSaved(QString map_name, bool written);
+    void onMapSaveFailed(QString map_name);
 
     void on_action_Save_triggered();
     void on_tabWidget_2_currentChanged(int index);
@@ -68,12 +81,16 @@ private slots:
 private:
     Ui::MainWindow *ui;
     Editor *editor = NULL;
+    MapLoader *map_loader = NULL;
+    MapSaver *map_saver = NULL;
+    SourceWatcher *source_watcher = NULL;
     void setMap(QString);
     void populateMapList();
     QString getExistingDirectory(QString);
     void openProject(QString dir);
     QString getDefaultMap();
     void setRecentMap(QString map_name);
+    void preloadProject();
 
     void markAllEdited(QAbstractItemModel *model);
     void markEdited(QModelIndex index);
@@ -1,4 +1,5 @@
 #include "map.h"
+#include "trace.h"
 
 #include <QTime>
 #include <QDebug>
@@ -16,6 +17,22 @@ Map::Map(QObject *parent) : QObject(parent)
     paint_elevation = 3;
 }
 
+// Tilesets are shared, and belong to the project.
+Map::~Map()
+{
+    delete blockdata;
+    delete cached_blockdata;
+    delete cached_collision;
+    delete border;
+    delete cached_border;
+    delete committed_blockdata;
+    history.clear();
+    for (QList<Event*> list : events.values()) {
+        qDeleteAll(list);
+    }
+    qDeleteAll(connections);
+}
+
 int Map::getWidth() {
     return width.toInt(nullptr, 0);
 }
@@ -162,62 +179,44 @@ QImage Map::getMetatileImage(int tile) {
     return metatile_image;
 }
 
-bool Map::blockChanged(int i, Blockdata *cache) {
-    if (cache == NULL || cache == nullptr) {
-        return true;
-    }
-    if (blockdata == NULL || blockdata == nullptr) {
-        return true;
-    }
-    if (cache->blocks == NULL || cache->blocks == nullptr) {
-        return true;
-    }
-    if (blockdata->blocks == NULL || blockdata->blocks == nullptr) {
-        return true;
-    }
-    if (cache->blocks->length() <= i) {
-        return true;
-    }
-    if (blockdata->blocks->length() <= i) {
-        return true;
-    }
-    return blockdata->blocks->value(i) != cache->blocks->value(i);
-}
-
 void Map::cacheBorder() {
     if (cached_border) delete cached_border;
     cached_border = new Blockdata;
-    if (border && border->blocks) {
-        for (int i = 0; i < border->blocks->length(); i++) {
-            Block block = border->blocks->value(i);
-            cached_border->blocks->append(block);
-        }
+    if (border) {
+        cached_border->copyFrom(border);
     }
 }
 
 void Map::cacheBlockdata() {
     if (cached_blockdata) delete cached_blockdata;
     cached_blockdata = new Blockdata;
-    if (blockdata && blockdata->blocks) {
-        for (int i = 0; i < blockdata->blocks->length(); i++) {
-            Block block = blockdata->blocks->value(i);
-            cached_blockdata->blocks->append(block);
-        }
+    if (blockdata) {
+        cached_blockdata->copyFrom(blockdata);
     }
 }
 
 void Map::cacheCollision() {
     if (cached_collision) delete cached_collision;
     cached_collision = new Blockdata;
-    if (blockdata && blockdata->blocks) {
-        for (int i = 0; i < blockdata->blocks->length(); i++) {
-            Block block = blockdata->blocks->value(i);
-            cached_collision->blocks->append(block);
-        }
+    if (blockdata) {
+        cached_collision->copyFrom(blockdata);
     }
 }
 
+// Forces the next render to redraw every block, e.g. after the tilesets change.
+void Map::clearRenderCache() {
+    if (cached_blockdata) delete cached_blockdata;
+    cached_blockdata = new Blockdata;
+    if (cached_collision) delete cached_collision;
+    cached_collision = new Blockdata;
+    if (cached_border) delete cached_border;
+    cached_border = new Blockdata;
+}
+
 QPixmap Map::renderCollision() {
+    TRACE_SCOPE("Map::renderCollision");
+    TRACE_ARG("map", name);
+    TRACE_ARG("blocks", blockdata ? blockdata->length() : 0);
     bool changed_any = false;
     int width_ = getWidth();
     int height_ = getHeight();
@@ -229,53 +228,52 @@ QPixmap Map::renderCollision() {
         collision_image = QImage(width_ * 16, height_ * 16, QImage::Format_RGBA8888);
         changed_any = true;
     }
-    if (!(blockdata && blockdata->blocks && width_ && height_)) {
+    if (!(blockdata && width_ && height_)) {
         collision_pixmap = collision_pixmap.fromImage(collision_image);
         return collision_pixmap;
     }
     QPainter painter(&collision_image);
-    for (int i = 0; i < blockdata->blocks->length(); i++) {
-        if (cached_collision && !blockChanged(i, cached_collision)) {
-            continue;
-        }
+    for (BlockRange range : Blockdata::diff(blockdata, cached_collision)) {
         changed_any = true;
-        Block block = blockdata->blocks->value(i);
-        QImage metatile_image = getMetatileImage(block.tile);
-        QImage collision_metatile_image = getCollisionMetatileImage(block);
-        QImage elevation_metatile_image = getElevationMetatileImage(block);
-        int map_y = width_ ? i / width_ : 0;
-        int map_x = width_ ? i % width_ : 0;
-        QPoint metatile_origin = QPoint(map_x * 16, map_y * 16);
-        painter.setOpacity(1);
-        painter.drawImage(metatile_origin, metatile_image);
-
-        painter.save();
-        if (block.elevation == 15) {
-            painter.setOpacity(0.5);
-        } else if (block.elevation == 0) {
-            painter.setOpacity(0);
-        } else {
-            painter.setOpacity(1);//(block.elevation / 16.0) * 0.8);
-            painter.setCompositionMode(QPainter::CompositionMode_Overlay);
-        }
-        painter.drawImage(metatile_origin, elevation_metatile_image);
-        painter.restore();
-
-        painter.save();
-        if (block.collision == 0) {
-            painter.setOpacity(0.1);
-        } else {
-            painter.setOpacity(0.4);
+        for (int i = range.first; i < range.second; i++) {
+            Block block = blockdata->block(i);
+            QImage metatile_image = getMetatileImage(block.tile);
+            QImage collision_metatile_image = getCollisionMetatileImage(block);
+            QImage elevation_metatile_image = getElevationMetatileImage(block);
+            int map_y = width_ ? i / width_ : 0;
+            int map_x = width_ ? i % width_ : 0;
+            QPoint metatile_origin = QPoint(map_x * 16, map_y * 16);
+            painter.setOpacity(1);
+            painter.drawImage(metatile_origin, metatile_image);
+
+            painter.save();
+            if (block.elevation == 15) {
+                painter.setOpacity(0.5);
+            } else if (block.elevation == 0) {
+                painter.setOpacity(0);
+            } else {
+                painter.setOpacity(1);//(block.elevation / 16.0) * 0.8);
+                painter.setCompositionMode(QPainter::CompositionMode_Overlay);
+            }
+            painter.drawImage(metatile_origin, elevation_metatile_image);
+            painter.restore();
+
+            painter.save();
+            if (block.collision == 0) {
+                painter.setOpacity(0.1);
+            } else {
+                painter.setOpacity(0.4);
+            }
+            painter.drawImage(metatile_origin, collision_metatile_image);
+            painter.restore();
+
+            painter.save();
+            painter.setOpacity(0.6);
+            painter.setPen(QColor(255, 255, 255, 192));
+            painter.setFont(QFont("Helvetica", 8));
+            painter.drawText(QPoint(metatile_origin.x(), metatile_origin.y() + 8), QString("%1").arg(block.elevation));
+            painter.restore();
         }
-        painter.drawImage(metatile_origin, collision_metatile_image);
-        painter.restore();
-
-        painter.save();
-        painter.setOpacity(0.6);
-        painter.setPen(QColor(255, 255, 255, 192));
-        painter.setFont(QFont("Helvetica", 8));
-        painter.drawText(QPoint(metatile_origin.x(), metatile_origin.y() + 8), QString("%1").arg(block.elevation));
-        painter.restore();
     }
     painter.end();
     cacheCollision();
@@ -286,6 +284,9 @@ QPixmap Map::renderCollision() {
 }
 
 QPixmap Map::render() {
+    TRACE_SCOPE("Map::render");
+    TRACE_ARG("map", name);
+    TRACE_ARG("blocks", blockdata ? blockdata->length() : 0);
     bool changed_any = false;
     int width_ = getWidth();
     int height_ = getHeight();
@@ -297,23 +298,22 @@ QPixmap Map::render() {
         image = QImage(width_ * 16, height_ * 16, QImage::Format_RGBA8888);
         changed_any = true;
     }
-    if (!(blockdata && blockdata->blocks && width_ && height_)) {
+    if (!(blockdata && width_ && height_)) {
         pixmap = pixmap.fromImage(image);
         return pixmap;
     }
 
     QPainter painter(&image);
-    for (int i = 0; i < blockdata->blocks->length(); i++) {
-        if (!blockChanged(i, cached_blockdata)) {
-            continue;
-        }
+    for (BlockRange range : Blockdata::diff(blockdata, cached_blockdata)) {
         changed_any = true;
-        Block block = blockdata->blocks->value(i);
-        QImage metatile_image = getMetatileImage(block.tile);
-        int map_y = width_ ? i / width_ : 0;
-        int map_x = width_ ? i % width_ : 0;
-        QPoint metatile_origin = QPoint(map_x * 16, map_y * 16);
-        painter.drawImage(metatile_origin, metatile_image);
+        for (int i = range.first; i < range.second; i++) {
+            Block block = blockdata->block(i);
+            QImage metatile_image = getMetatileImage(block.tile);
+            int map_y = width_ ? i / width_ : 0;
+            int map_x = width_ ? i % width_ : 0;
+            QPoint metatile_origin = QPoint(map_x * 16, map_y * 16);
+            painter.drawImage(metatile_origin, metatile_image);
+        }
     }
     painter.end();
     if (changed_any) {
@@ -324,6 +324,8 @@ QPixmap Map::render() {
 }
 
 QPixmap Map::renderBorder() {
+    TRACE_SCOPE("Map::renderBorder");
+    TRACE_ARG("map", name);
     bool changed_any = false;
     int width_ = 2;
     int height_ = 2;
@@ -331,21 +333,20 @@ QPixmap Map::renderBorder() {
         border_image = QImage(width_ * 16, height_ * 16, QImage::Format_RGBA8888);
         changed_any = true;
     }
-    if (!(border && border->blocks)) {
+    if (!border) {
         border_pixmap = border_pixmap.fromImage(border_image);
         return border_pixmap;
     }
     QPainter painter(&border_image);
-    for (int i = 0; i < border->blocks->length(); i++) {
-        if (!blockChanged(i, cached_border)) {
-            continue;
-        }
+    for (BlockRange range : Blockdata::diff(border, cached_border)) {
         changed_any = true;
-        Block block = border->blocks->value(i);
-        QImage metatile_image = getMetatileImage(block.tile);
-        int map_y = i / width_;
-        int map_x = i % width_;
-        painter.drawImage(QPoint(map_x * 16, map_y * 16), metatile_image);
+        for (int i = range.first; i < range.second; i++) {
+            Block block = border->block(i);
+            QImage metatile_image = getMetatileImage(block.tile);
+            int map_y = i / width_;
+            int map_x = i % width_;
+            painter.drawImage(QPoint(map_x * 16, map_y * 16), metatile_image);
+        }
     }
     painter.end();
     if (changed_any) {
@@ -356,6 +357,9 @@ QPixmap Map::renderBorder() {
 }
 
 QPixmap Map::renderConnection(Connection connection) {
+    TRACE_SCOPE("Map::renderConnection");
+    TRACE_ARG("map", name);
+    TRACE_ARG("direction", connection.direction);
     render();
     int x, y, w, h;
     if (connection.direction == "up") {
@@ -391,6 +395,8 @@ QPixmap Map::renderConnection(Connection connection) {
 }
 
 QPixmap Map::renderCollisionMetatiles() {
+    TRACE_SCOPE("Map::renderCollisionMetatiles");
+    TRACE_ARG("map", name);
     int length_ = 4;
     int height_ = 1;
     int width_ = length_ / height_;
@@ -409,6 +415,8 @@ QPixmap Map::renderCollisionMetatiles() {
 }
 
 QPixmap Map::renderElevationMetatiles() {
+    TRACE_SCOPE("Map::renderElevationMetatiles");
+    TRACE_ARG("map", name);
     int length_ = 16;
     int height_ = 2;
     int width_ = length_ / height_;
@@ -439,6 +447,8 @@ void Map::drawSelection(int i, int w, QPainter *painter) {
 }
 
 QPixmap Map::renderMetatiles() {
+    TRACE_SCOPE("Map::renderMetatiles");
+    TRACE_ARG("map", name);
     if (!tileset_primary || !tileset_primary->metatiles || !tileset_secondary || !tileset_secondary->metatiles) {
         return QPixmap();
     }
@@ -467,20 +477,33 @@ QPixmap Map::renderMetatiles() {
 }
 
 Block* Map::getBlock(int x, int y) {
-    if (blockdata && blockdata->blocks) {
+    Block block;
+    if (readBlock(x, y, &block)) {
+        return new Block(block);
+    }
+    return NULL;
+}
+
+// Like getBlock, but copies into the caller's Block instead of allocating.
+bool Map::readBlock(int x, int y, Block *block) {
+    if (blockdata) {
         if (x >= 0 && x < getWidth())
         if (y >= 0 && y < getHeight()) {
+            // map.bin can be shorter than the header says.
             int i = y * getWidth() + x;
-            return new Block(blockdata->blocks->value(i));
+            if (i < blockdata->length()) {
+                *block = blockdata->block(i);
+                return true;
+            }
         }
     }
-    return NULL;
+    return false;
 }
 
 void Map::_setBlock(int x, int y, Block block) {
     int i = y * getWidth() + x;
-    if (blockdata && blockdata->blocks) {
-        blockdata->blocks->replace(i, block);
+    if (blockdata && i >= 0 && i < blockdata->length()) {
+        blockdata->setBlock(i, block);
     }
 }
 
@@ -491,26 +514,26 @@ void Map::_floodFill(int x, int y, uint tile) {
             QPoint point = todo.takeAt(0);
             x = point.x();
             y = point.y();
-            Block *block = getBlock(x, y);
-            if (block == NULL) {
+            Block block;
+            if (!readBlock(x, y, &block)) {
                 continue;
             }
-            uint old_tile = block->tile;
+            uint old_tile = block.tile;
             if (old_tile == tile) {
                 continue;
             }
-            block->tile = tile;
-            _setBlock(x, y, *block);
-            if ((block = getBlock(x + 1, y)) && block->tile == old_tile) {
+            block.tile = tile;
+            _setBlock(x, y, block);
+            if (readBlock(x + 1, y, &block) && block.tile == old_tile) {
                 todo.append(QPoint(x + 1, y));
             }
-            if ((block = getBlock(x - 1, y)) && block->tile == old_tile) {
+            if (readBlock(x - 1, y, &block) && block.tile == old_tile) {
                 todo.append(QPoint(x - 1, y));
             }
-            if ((block = getBlock(x, y + 1)) && block->tile == old_tile) {
+            if (readBlock(x, y + 1, &block) && block.tile == old_tile) {
                 todo.append(QPoint(x, y + 1));
             }
-            if ((block = getBlock(x, y - 1)) && block->tile == old_tile) {
+            if (readBlock(x, y - 1, &block) && block.tile == old_tile) {
                 todo.append(QPoint(x, y - 1));
             }
     }
@@ -523,26 +546,26 @@ void Map::_floodFillCollision(int x, int y, uint collision) {
             QPoint point = todo.takeAt(0);
             x = point.x();
             y = point.y();
-            Block *block = getBlock(x, y);
-            if (block == NULL) {
+            Block block;
+            if (!readBlock(x, y, &block)) {
                 continue;
             }
-            uint old_coll = block->collision;
+            uint old_coll = block.collision;
             if (old_coll == collision) {
                 continue;
             }
-            block->collision = collision;
-            _setBlock(x, y, *block);
-            if ((block = getBlock(x + 1, y)) && block->collision == old_coll) {
+            block.collision = collision;
+            _setBlock(x, y, block);
+            if (readBlock(x + 1, y, &block) && block.collision == old_coll) {
                 todo.append(QPoint(x + 1, y));
             }
-            if ((block = getBlock(x - 1, y)) && block->collision == old_coll) {
+            if (readBlock(x - 1, y, &block) && block.collision == old_coll) {
                 todo.append(QPoint(x - 1, y));
             }
-            if ((block = getBlock(x, y + 1)) && block->collision == old_coll) {
+            if (readBlock(x, y + 1, &block) && block.collision == old_coll) {
                 todo.append(QPoint(x, y + 1));
             }
-            if ((block = getBlock(x, y - 1)) && block->collision == old_coll) {
+            if (readBlock(x, y - 1, &block) && block.collision == old_coll) {
                 todo.append(QPoint(x, y - 1));
             }
     }
@@ -555,27 +578,26 @@ void Map::_floodFillElevation(int x, int y, uint elevation) {
             QPoint point = todo.takeAt(0);
             x = point.x();
             y = point.y();
-            Block *block = getBlock(x, y);
-            if (block == NULL) {
+            Block block;
+            if (!readBlock(x, y, &block)) {
                 continue;
             }
-            uint old_z = block->elevation;
+            uint old_z = block.elevation;
             if (old_z == elevation) {
                 continue;
             }
-            Block block_(*block);
-            block_.elevation = elevation;
-            _setBlock(x, y, block_);
-            if ((block = getBlock(x + 1, y)) && block->elevation == old_z) {
+            block.elevation = elevation;
+            _setBlock(x, y, block);
+            if (readBlock(x + 1, y, &block) && block.elevation == old_z) {
                 todo.append(QPoint(x + 1, y));
             }
-            if ((block = getBlock(x - 1, y)) && block->elevation == old_z) {
+            if (readBlock(x - 1, y, &block) && block.elevation == old_z) {
                 todo.append(QPoint(x - 1, y));
             }
-            if ((block = getBlock(x, y + 1)) && block->elevation == old_z) {
+            if (readBlock(x, y + 1, &block) && block.elevation == old_z) {
                 todo.append(QPoint(x, y + 1));
             }
-            if ((block = getBlock(x, y - 1)) && block->elevation == old_z) {
+            if (readBlock(x, y - 1, &block) && block.elevation == old_z) {
                 todo.append(QPoint(x, y - 1));
             }
     }
@@ -588,28 +610,28 @@ void Map::_floodFillCollisionElevation(int x, int y, uint collision, uint elevat
             QPoint point = todo.takeAt(0);
             x = point.x();
             y = point.y();
-            Block *block = getBlock(x, y);
-            if (block == NULL) {
+            Block block;
+            if (!readBlock(x, y, &block)) {
                 continue;
             }
-            uint old_coll = block->collision;
-            uint old_elev = block->elevation;
+            uint old_coll = block.collision;
+            uint old_elev = block.elevation;
             if (old_coll == collision && old_elev == elevation) {
                 continue;
             }
-            block->collision = collision;
-            block->elevation = elevation;
-            _setBlock(x, y, *block);
-            if ((block = getBlock(x + 1, y)) && block->collision == old_coll && block->elevation == old_elev) {
+            block.collision = collision;
+            block.elevation = elevation;
+            _setBlock(x, y, block);
+            if (readBlock(x + 1, y, &block) && block.collision == old_coll && block.elevation == old_elev) {
                 todo.append(QPoint(x + 1, y));
             }
-            if ((block = getBlock(x - 1, y)) && block->collision == old_coll && block->elevation == old_elev) {
+            if (readBlock(x - 1, y, &block) && block.collision == old_coll && block.elevation == old_elev) {
                 todo.append(QPoint(x - 1, y));
             }
-            if ((block = getBlock(x, y + 1)) && block->collision == old_coll && block->elevation == old_elev) {
+            if (readBlock(x, y + 1, &block) && block.collision == old_coll && block.elevation == old_elev) {
                 todo.append(QPoint(x, y + 1));
             }
-            if ((block = getBlock(x, y - 1)) && block->collision == old_coll && block->elevation == old_elev) {
+            if (readBlock(x, y - 1, &block) && block.collision == old_coll && block.elevation == old_elev) {
                 todo.append(QPoint(x, y - 1));
             }
     }
@@ -618,9 +640,10 @@ void Map::_floodFillCollisionElevation(int x, int y, uint collision, uint elevat
 
 void Map::undo() {
     if (blockdata) {
-        Blockdata *commit = history.back();
-        if (commit != NULL) {
-            blockdata->copyFrom(commit);
+        BlockDelta *commit = history.current();
+        if (commit != NULL && history.back() != NULL) {
+            commit->undo(blockdata);
+            commit->undo(committed_blockdata);
             emit mapChanged(this);
         }
     }
@@ -628,9 +651,10 @@ void Map::undo() {
 
 void Map::redo() {
     if (blockdata) {
-        Blockdata *commit = history.next();
+        BlockDelta *commit = history.next();
         if (commit != NULL) {
-            blockdata->copyFrom(commit);
+            commit->redo(blockdata);
+            commit->redo(committed_blockdata);
             emit mapChanged(this);
         }
     }
@@ -638,48 +662,57 @@ void Map::redo() {
 
 void Map::commit() {
     if (blockdata) {
-        if (!blockdata->equals(history.current())) {
-            Blockdata* commit = blockdata->copy();
-            history.push(commit);
+        if (!committed_blockdata) {
+            committed_blockdata = blockdata->copy();
+            history.push(new BlockDelta);
             emit mapChanged(this);
+            return;
+        }
+        BlockDelta *commit = BlockDelta::diff(committed_blockdata, blockdata);
+        if (commit->isEmpty()) {
+            delete commit;
+            return;
         }
+        commit->redo(committed_blockdata);
+        history.push(commit);
+        emit mapChanged(this);
     }
 }
 
 void Map::setBlock(int x, int y, Block block) {
-    Block *old_block = getBlock(x, y);
-    if (old_block && (*old_block) != block) {
+    Block old_block;
+    if (readBlock(x, y, &old_block) && old_block != block) {
         _setBlock(x, y, block);
         commit();
     }
 }
 
 void Map::floodFill(int x, int y, uint tile) {
-    Block *block = getBlock(x, y);
-    if (block && block->tile != tile) {
+    Block block;
+    if (readBlock(x, y, &block) && block.tile != tile) {
         _floodFill(x, y, tile);
         commit();
     }
 }
 
 void Map::floodFillCollision(int x, int y, uint collision) {
-    Block *block = getBlock(x, y);
-    if (block && block->collision != collision) {
+    Block block;
+    if (readBlock(x, y, &block) && block.collision != collision) {
         _floodFillCollision(x, y, collision);
         commit();
     }
 }
 
 void Map::floodFillElevation(int x, int y, uint elevation) {
-    Block *block = getBlock(x, y);
-    if (block && block->elevation != elevation) {
+    Block block;
+    if (readBlock(x, y, &block) && block.elevation != elevation) {
         _floodFillElevation(x, y, elevation);
         commit();
     }
 }
 void Map::floodFillCollisionElevation(int x, int y, uint collision, uint elevation) {
-    Block *block = getBlock(x, y);
-    if (block && (block->collision != collision || block->elevation != elevation)) {
+    Block block;
+    if (readBlock(x, y, &block) && (block.collision != collision || block.elevation != elevation)) {
         _floodFillCollisionElevation(x, y, collision, elevation);
         commit();
     }
@@ -709,5 +742,98 @@ void Map::addEvent(Event *event) {
 }
 
 bool Map::hasUnsavedChanges() {
+    return isBlockdataDirty() || isBorderDirty() || isHeaderDirty() || isEventsDirty();
+}
+
+bool Map::isBlockdataDirty() {
     return !history.isSaved();
 }
+
+// Everything else doesn't go through the history, so it's compared against what was last loaded or saved.
+bool Map::isBorderDirty() {
+    QByteArray data = border ? border->serialize() : QByteArray();
+    return data != saved_border;
+}
+
+bool Map::isHeaderDirty() {
+    return getHeaderValues() != saved_header_values;
+}
+
+bool Map::isEventsDirty() {
+    return getEventValues() != saved_event_values;
+}
+
+// The fields saved to header.inc.
+QStringList Map::getHeaderValues() {
+    QStringList values;
+    values << attributes_label << events_label << scripts_label << connections_label;
+    values << song << index << location << visibility << weather << type;
+    values << unknown << show_location << battle_scene;
+    return values;
+}
+
+QList<QMap<QString, QString>> Map::getEventValues() {
+    QList<QMap<QString, QString>> values;
+    for (Event *event : getAllEvents()) {
+        values.append(event->values);
+    }
+    return values;
+}
+
+void Map::markSaved() {
+    markBlockdataSaved();
+    markBorderSaved();
+    markHeaderSaved();
+    markEventsSaved();
+}
+
+void Map::markBlockdataSaved() {
+    history.save();
+}
+
+void Map::markBorderSaved() {
+    saved_border = border ? border->serialize() : QByteArray();
+}
+
+void Map::markHeaderSaved() {
+    saved_header_values = getHeaderValues();
+}
+
+void Map::markEventsSaved() {
+    saved_event_values = getEventValues();
+}
+
+static qint64 imageBytes(const QImage &image) {
+    return (qint64)image.bytesPerLine() * image.height();
+}
+
+static qint64 pixmapBytes(const QPixmap &pixmap) {
+    return (qint64)pixmap.width() * pixmap.height() * pixmap.depth() / 8;
+}
+
+// A rough estimate of what this map keeps alive, for the cache budget.
+qint64 Map::memoryUsage() {
+    // Copies share their blocks until they're edited, so this overcounts a little.
+    qint64 block_bytes = sizeof(uint16_t);
+    qint64 num_blocks = 0;
+    QList<Blockdata*> blockdatas;
+    blockdatas << blockdata << cached_blockdata << cached_collision << border << cached_border << committed_blockdata;
+    for (Blockdata *data : blockdatas) {
+        if (data) {
+            num_blocks += data->length();
+        }
+    }
+
+    qint64 total = num_blocks * block_bytes;
+    total += history.memoryUsage();
+    total += imageBytes(image) + imageBytes(collision_image) + imageBytes(border_image);
+    total += pixmapBytes(pixmap) + pixmapBytes(collision_pixmap) + pixmapBytes(border_pixmap);
+    for (QImage metatile_image : metatile_images) {
+        total += imageBytes(metatile_image);
+    }
+    for (Event *event : getAllEvents()) {
+        total += 64 * (event->values.count() + 1);
+        total += pixmapBytes(event->pixmap);
+    }
+    return total;
+}
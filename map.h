@@ -3,6 +3,7 @@
 
 #include "tileset.h"
 #include "blockdata.h"
+#include "blockdelta.h"
 #include "event.h"
 
 #include <QPixmap>
@@ -16,27 +17,37 @@ public:
     History() {
 
     }
+    // Undo applies the commit at head before back() moves off it, and redo the one next() moves onto.
+    // Either can decompress it, so it's measured and compressed again later.
     T back() {
         if (head > 0) {
+            touch(head);
             return history.at(--head);
         }
         return NULL;
     }
     T next() {
         if (head + 1 < history.length()) {
+            touch(head + 1);
             return history.at(++head);
         }
         return NULL;
     }
     void push(T commit) {
         while (head + 1 < history.length()) {
-            history.removeLast();
+            delete history.takeLast();
+            ids.removeLast();
+            usage -= sizes.takeLast();
         }
+        touch(history.length());
         if (saved > head) {
             saved = -1;
         }
         history.append(commit);
+        ids.append(++last_id);
+        sizes.append(0);
         head++;
+        trim();
     }
     T current() {
         if (head < 0 || history.length() == 0) {
@@ -44,17 +55,108 @@ public:
         }
         return history.at(head);
     }
+    // Ids are never reused, unlike the addresses of commits that have been deleted. 0 is no commit.
+    quint64 currentId() {
+        if (head < 0 || ids.length() == 0) {
+            return 0;
+        }
+        return ids.at(head);
+    }
     void save() {
         saved = head;
     }
+    // Marks an earlier state as saved, if that commit is still in the history.
+    void saveAt(quint64 id) {
+        int index = ids.indexOf(id);
+        if (id && index >= 0) {
+            saved = index;
+        }
+    }
     bool isSaved() {
         return saved == head;
     }
+    int length() {
+        return history.length();
+    }
+    T at(int index) {
+        return history.at(index);
+    }
+    // Commits are owned by the history.
+    void clear() {
+        qDeleteAll(history);
+        history.clear();
+        ids.clear();
+        sizes.clear();
+        usage = 0;
+        measured = 0;
+        compressed = 0;
+        head = -1;
+        saved = -1;
+    }
+    // Past the limit, the oldest commits are dropped. 0 means no limit.
+    // Once there is a limit, commits more than a few undos back are compressed.
+    void setMemoryLimit(qint64 limit) {
+        memory_limit = limit;
+        trim();
+    }
+    qint64 memoryUsage() {
+        measure();
+        return usage;
+    }
 
 private:
+    // The total is kept as commits come and go, so an edit doesn't walk the whole history.
+    void touch(int index) {
+        measured = qMin(measured, index);
+        compressed = qMin(compressed, index);
+    }
+    void remeasure(int index) {
+        qint64 size = history.at(index)->memoryUsage();
+        usage += size - sizes.at(index);
+        sizes[index] = size;
+    }
+    void measure() {
+        for (int i = measured; i < history.length(); i++) {
+            remeasure(i);
+        }
+        measured = history.length();
+    }
+    void trim() {
+        measure();
+        if (memory_limit <= 0) {
+            return;
+        }
+        for (int i = compressed; i < head - uncompressed_commits; i++) {
+            history.at(i)->compress();
+            remeasure(i);
+        }
+        compressed = qMax(compressed, head - uncompressed_commits);
+        // The current commit always stays. There is nothing before the first to undo to,
+        // so it's only a starting point, and whatever comes after it can take over.
+        while (head > 0 && usage > memory_limit) {
+            delete history.takeFirst();
+            ids.removeFirst();
+            usage -= sizes.takeFirst();
+            measured = qMax(measured - 1, 0);
+            compressed = qMax(compressed - 1, 0);
+            head--;
+            // If the saved state was dropped, it can't be undone back to, so what's current isn't saved.
+            saved = qMax(saved - 1, -1);
+        }
+    }
+
     QList<T> history;
+    QList<quint64> ids;
+    QList<qint64> sizes;
+    qint64 usage = 0;
+    // Commits before these indices have an up to date size, and have been compressed.
+    int measured = 0;
+    int compressed = 0;
+    quint64 last_id = 0;
     int head = -1;
     int saved = -1;
+    qint64 memory_limit = 0;
+    int uncompressed_commits = 8;
 };
 
 class Connection {
@@ -72,6 +174,7 @@ class Map : public QObject
     Q_OBJECT
 public:
     explicit Map(QObject *parent = 0);
+    ~Map();
 
 public:
     QString name;
@@ -100,6 +203,13 @@ public:
     Tileset *tileset_secondary = NULL;
 
     Blockdata* blockdata = NULL;
+    QString blockdata_path;
+    QString border_path;
+
+    // The files this map was built from.
+    QStringList sources;
+    QMap<QString, SourceStamp> source_stamps;
+    bool from_cache = false;
 
 public:
     int getWidth();
@@ -124,7 +234,6 @@ public:
     QPixmap renderElevationMetatiles();
     void drawSelection(int i, int w, QPainter *painter);
 
-    bool blockChanged(int, Blockdata*);
     Blockdata* cached_blockdata = NULL;
     void cacheBlockdata();
     Blockdata* cached_collision = NULL;
@@ -137,6 +246,7 @@ public:
     int paint_elevation;
 
     Block *getBlock(int x, int y);
+    bool readBlock(int x, int y, Block *block);
     void setBlock(int x, int y, Block block);
     void _setBlock(int x, int y, Block block);
 
@@ -149,7 +259,9 @@ public:
     void floodFillCollisionElevation(int x, int y, uint collision, uint elevation);
     void _floodFillCollisionElevation(int x, int y, uint collision, uint elevation);
 
-    History<Blockdata*> history;
+    // Each commit is the change from the one before it. The first is empty, and marks where history starts.
+    History<BlockDelta*> history;
+    Blockdata *committed_blockdata = NULL; // The blocks as of the current commit.
     void undo();
     void redo();
     void commit();
@@ -174,8 +286,25 @@ public:
     Blockdata *cached_border = NULL;
     QPixmap renderBorder();
     void cacheBorder();
+    void clearRenderCache();
 
+    // Each file a map is saved to is tracked separately, so saving only writes what changed.
     bool hasUnsavedChanges();
+    bool isBlockdataDirty();
+    bool isBorderDirty();
+    bool isHeaderDirty();
+    bool isEventsDirty();
+    QList<QMap<QString, QString>> getEventValues();
+    QList<QMap<QString, QString>> saved_event_values;
+    QStringList getHeaderValues();
+    QStringList saved_header_values;
+    QByteArray saved_border;
+    void markSaved();
+    void markBlockdataSaved();
+    void markBorderSaved();
+    void markHeaderSaved();
+    void markEventsSaved();
+    qint64 memoryUsage();
 
     QList<QList<QRgb> > getBlockPalettes(int metatile_index);
 
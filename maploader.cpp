@@ -0,0 +1,220 @@
+#include "maploader.h"
+
+#include <QtConcurrent>
+#include <QFutureWatcher>
+#include <QElapsedTimer>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#include <psapi.h>
+#elif defined(Q_OS_UNIX)
+#include <sys/resource.h>
+#endif
+
+// Peak resident memory of the process in bytes, or -1 if unknown.
+static qint64 peakMemoryUsage() {
+#if defined(Q_OS_WIN)
+    PROCESS_MEMORY_COUNTERS counters;
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return counters.PeakWorkingSetSize;
+    }
+#elif defined(Q_OS_UNIX)
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) == 0) {
+#if defined(Q_OS_MAC)
+        return usage.ru_maxrss;
+#else
+        return usage.ru_maxrss * 1024;
+#endif
+    }
+#endif
+    return -1;
+}
+
+MapLoader::MapLoader(QObject *parent) : QObject(parent)
+{
+}
+
+// Workers call back into this object, so they have to be done before it goes.
+// Whatever they finish with never gets handed over, so it's freed here.
+MapLoader::~MapLoader()
+{
+    cancel();
+    cancelPreload();
+    for (QFuture<Map*> future : loads) {
+        future.waitForFinished();
+        delete future.result();
+    }
+    for (QFuture<QList<Map*>> future : preloads) {
+        future.waitForFinished();
+        qDeleteAll(future.result());
+    }
+}
+
+QFuture<Map*> MapLoader::load(Project *project, QString map_name) {
+    int generation_ = generation.fetchAndAddOrdered(1) + 1;
+    project->loads_in_flight.ref();
+
+    QFuture<Map*> future = QtConcurrent::run(this, &MapLoader::run, project, map_name, generation_);
+    loads.append(future);
+    QFutureWatcher<Map*> *watcher = new QFutureWatcher<Map*>(this);
+    connect(watcher, &QFutureWatcher<Map*>::finished, this, [=]() {
+        loads.removeOne(future);
+        Map *map = watcher->result();
+        watcher->deleteLater();
+        project->loads_in_flight.deref();
+        if (map && !isCanceled(generation_)) {
+            project->cacheMap(map);
+            project->trimCache();
+            emit loaded(map);
+        } else {
+            if (map) {
+                delete map;
+            }
+            emit canceled(map_name);
+        }
+    });
+    watcher->setFuture(future);
+    return future;
+}
+
+void MapLoader::cancel() {
+    generation.fetchAndAddOrdered(1);
+}
+
+// The maps it loaded so far are thrown away, not cached.
+void MapLoader::cancelPreload() {
+    preload_generation.fetchAndAddOrdered(1);
+}
+
+bool MapLoader::isCanceled(int generation_) {
+    return generation.loadAcquire() != generation_;
+}
+
+bool MapLoader::isPreloadCanceled(int generation_) {
+    return preload_generation.loadAcquire() != generation_;
+}
+
+// Runs on the worker thread.
+// The finished map is handed back to this object's thread to be cached.
+Map* MapLoader::run(Project *project, QString map_name, int generation_) {
+    QStringList stages = project->getMapLoadStages();
+    Map *map = new Map;
+    map->name = map_name;
+    for (int i = 0; i < stages.length(); i++) {
+        if (isCanceled(generation_)) {
+            delete map;
+            return NULL;
+        }
+        emit progress(map_name, stages.value(i), i, stages.length());
+        project->loadMapStage(map, i);
+    }
+    emit progress(map_name, "done", stages.length(), stages.length());
+    map->moveToThread(thread());
+    return map;
+}
+
+// Loads every map that isn't cached yet, and every tileset they use, across all cores.
+QFuture<QList<Map*>> MapLoader::preload(Project *project) {
+    QElapsedTimer timer;
+    timer.start();
+
+    QStringList map_names;
+    for (QString map_name : *project->mapNames) {
+        if (!project->map_cache->contains(map_name)) {
+            map_names.append(map_name);
+        }
+    }
+
+    int generation_ = preload_generation.loadAcquire();
+    project->loads_in_flight.ref();
+    QFuture<QList<Map*>> future = QtConcurrent::run(this, &MapLoader::runPreload, project, map_names, generation_);
+    preloads.append(future);
+    QFutureWatcher<QList<Map*>> *watcher = new QFutureWatcher<QList<Map*>>(this);
+    connect(watcher, &QFutureWatcher<QList<Map*>>::finished, this, [=]() {
+        preloads.removeOne(future);
+        QList<Map*> maps = watcher->result();
+        watcher->deleteLater();
+        project->loads_in_flight.deref();
+        if (isPreloadCanceled(generation_)) {
+            // Some of these are only partly loaded, and the project may not be open anymore.
+            qDeleteAll(maps);
+            return;
+        }
+        for (Map *map : maps) {
+            if (project->map_cache->contains(map->name)) {
+                // It was opened while we were busy. Keep that one.
+                delete map;
+            } else {
+                project->cacheMap(map);
+            }
+        }
+        // Everything stays cached if it fits the budget. Otherwise this only leaves the parsed project cache warm.
+        project->trimCache();
+        int num_tilesets;
+        {
+            QMutexLocker locker(&project->cache_lock);
+            num_tilesets = project->tileset_cache->count();
+        }
+        emit preloaded(project, project->map_cache->count(), num_tilesets, timer.elapsed(), peakMemoryUsage());
+    });
+    watcher->setFuture(future);
+    return future;
+}
+
+// Once canceled, the remaining stages are skipped. The maps are still returned so they can be freed.
+QList<Map*> MapLoader::runPreload(Project *project, QStringList map_names, int generation_) {
+    // Parse the files every map shares up front, instead of letting the workers race to parse them.
+    project->getAsmFile(project->root + "/data/maps/_assets.inc");
+    project->getAsmFile(project->root + "/data/tilesets/headers.inc");
+    project->getAsmFile(project->root + "/data/tilesets/graphics.inc");
+    project->getAsmFile(project->root + "/data/tilesets/metatiles.inc");
+
+    QList<Map*> maps;
+    for (QString map_name : map_names) {
+        Map *map = new Map;
+        map->name = map_name;
+        maps.append(map);
+    }
+
+    // The header and attributes say which tilesets are needed.
+    QtConcurrent::blockingMap(maps, [=](Map *map) {
+        if (isPreloadCanceled(generation_)) {
+            return;
+        }
+        project->loadMapStage(map, 0);
+        project->loadMapStage(map, 1);
+    });
+
+    // Load each tileset once, rather than once per map that races for it.
+    QStringList labels;
+    for (Map *map : maps) {
+        if (!labels.contains(map->tileset_primary_label)) {
+            labels.append(map->tileset_primary_label);
+        }
+        if (!labels.contains(map->tileset_secondary_label)) {
+            labels.append(map->tileset_secondary_label);
+        }
+    }
+    QtConcurrent::blockingMap(labels, [=](const QString &label) {
+        if (isPreloadCanceled(generation_)) {
+            return;
+        }
+        project->getTileset(label);
+    });
+
+    int num_stages = project->getMapLoadStages().length();
+    QtConcurrent::blockingMap(maps, [=](Map *map) {
+        for (int i = 2; i < num_stages; i++) {
+            if (isPreloadCanceled(generation_)) {
+                return;
+            }
+            project->loadMapStage(map, i);
+        }
+    });
+
+    for (Map *map : maps) {
+        map->moveToThread(thread());
+    }
+    return maps;
+}
@@ -0,0 +1,45 @@
+#ifndef MAPLOADER_H
+#define MAPLOADER_H
+
+#include "project.h"
+
+#include <QObject>
+#include <QFuture>
+#include <QList>
+#include <QAtomicInt>
+
+// Loads maps on a worker thread.
+// Only the most recent load is kept. Starting a new one cancels the last.
+// A preload runs alongside loads, and is only stopped by cancelPreload().
+class MapLoader : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MapLoader(QObject *parent = 0);
+    ~MapLoader();
+
+public:
+    QFuture<Map*> load(Project *project, QString map_name);
+    void cancel();
+    void cancelPreload();
+    QFuture<QList<Map*>> preload(Project *project);
+
+signals:
+    void progress(QString map_name, QString stage, int step, int total);
+    void loaded(Map *map);
+    void canceled(QString map_name);
+    void preloaded(Project *project, int num_maps, int num_tilesets, qint64 msecs, qint64 peak_memory);
+
+private:
+    Map* run(Project *project, QString map_name, int generation_);
+    bool isCanceled(int generation_);
+    bool isPreloadCanceled(int generation_);
+    QList<Map*> runPreload(Project *project, QStringList map_names, int generation_);
+    QAtomicInt generation;
+    QAtomicInt preload_generation;
+    // Work that hasn't been handed back to this object's thread yet.
+    QList<QFuture<Map*>> loads;
+    QList<QFuture<QList<Map*>>> preloads;
+};
+
+#endif // MAPLOADER_H
@@ -0,0 +1,84 @@
+#include "mapsaver.h"
+
+#include <QtConcurrent>
+#include <QFutureWatcher>
+#include <QSharedPointer>
+
+MapSaver::MapSaver(QObject *parent) : QObject(parent)
+{
+}
+
+void MapSaver::save(Project *project, Map *map) {
+    if (in_flight.contains(map->name)) {
+        // Writing an older snapshot after a newer one would lose edits. Wait for it.
+        pending.insert(map->name);
+        return;
+    }
+    QSharedPointer<MapSnapshot> snapshot(new MapSnapshot(project->snapshotMap(map)));
+    if (!snapshot->blockdata && !snapshot->border && !snapshot->header && !snapshot->events) {
+        emit saved(map->name, false);
+        return;
+    }
+
+    QString map_name = map->name;
+    Save job;
+    job.project = project;
+    job.map = map;
+    job.snapshot = snapshot;
+    job.watcher = new QFutureWatcher<bool>(this);
+    connect(job.watcher, &QFutureWatcher<bool>::finished, this, [=]() {
+        finish(map_name);
+    });
+
+    QFuture<bool> future = QtConcurrent::run([project, snapshot]() {
+        return project->writeMapSnapshot(snapshot.data());
+    });
+    in_flight.insert(map_name, job);
+    job.watcher->setFuture(future);
+}
+
+// Runs on this object's thread once the map's write is done, or from waitForFinished.
+void MapSaver::finish(QString map_name) {
+    if (!in_flight.contains(map_name)) {
+        return;
+    }
+    Save job = in_flight.take(map_name);
+    job.watcher->disconnect(this);
+    job.watcher->waitForFinished();
+    bool ok = job.watcher->result();
+    job.watcher->deleteLater();
+    // Maps with unsaved changes aren't evicted, but the map could have been reloaded from disk.
+    if (job.map && job.project->map_cache->value(map_name) == job.map) {
+        job.project->markSnapshotSaved(job.map, *job.snapshot);
+    }
+    if (ok) {
+        emit saved(map_name, job.snapshot->written);
+    } else {
+        emit saveFailed(map_name);
+    }
+    if (pending.remove(map_name) && job.map) {
+        save(job.project, job.map);
+    }
+}
+
+void MapSaver::saveAll(Project *project) {
+    for (Map *map : project->map_cache->values()) {
+        if (map->hasUnsavedChanges()) {
+            save(project, map);
+        }
+    }
+}
+
+bool MapSaver::isSaving(QString map_name) {
+    return in_flight.contains(map_name);
+}
+
+// Blocks until everything that has been started, and every save queued behind it, is on disk.
+// Finishing a save starts the one queued for that map, so this goes until neither is left.
+void MapSaver::waitForFinished() {
+    while (!in_flight.isEmpty()) {
+        for (QString map_name : in_flight.keys()) {
+            finish(map_name);
+        }
+    }
+}
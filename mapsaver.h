@@ -0,0 +1,47 @@
+#ifndef MAPSAVER_H
+#define MAPSAVER_H
+
+#include "project.h"
+
+#include <QObject>
+#include <QFutureWatcher>
+#include <QSharedPointer>
+#include <QHash>
+#include <QSet>
+#include <QPointer>
+
+// Saves maps on worker threads while editing continues.
+// Each map is snapshotted on this object's thread, then written in the background,
+// several maps at a time. Saves of the same map never overlap: saving a map
+// that's still being written queues another save for when it finishes.
+class MapSaver : public QObject
+{
+    Q_OBJECT
+public:
+    explicit MapSaver(QObject *parent = 0);
+
+public:
+    void save(Project *project, Map *map);
+    void saveAll(Project *project);
+    bool isSaving(QString map_name);
+    void waitForFinished();
+
+signals:
+    void saved(QString map_name, bool written);
+    void saveFailed(QString map_name);
+
+private:
+    class Save
+    {
+    public:
+        Project *project = NULL;
+        QPointer<Map> map;
+        QSharedPointer<MapSnapshot> snapshot;
+        QFutureWatcher<bool> *watcher = NULL;
+    };
+    void finish(QString map_name);
+    QHash<QString, Save> in_flight;
+    QSet<QString> pending;
+};
+
+#endif // MAPSAVER_H
@@ -0,0 +1,88 @@
+#include "migrator.h"
+
+#include <QtConcurrent>
+#include <QElapsedTimer>
+#include <QTextStream>
+#include <QFileInfo>
+
+Migrator::Migrator(QString root_)
+{
+    root = root_;
+}
+
+int Migrator::run() {
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+    if (!QFileInfo(root + "/data/maps/_groups.inc").exists()) {
+        err << QString("'%1' does not look like a project\n").arg(root);
+        return 1;
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    project = new Project;
+    project->root = root;
+    project->readMapGroups();
+
+    // Parse the files every map shares up front, instead of letting the workers race to parse them.
+    project->getAsmFile(root + "/data/maps/_assets.inc");
+
+    QList<MigrationResult> results = QtConcurrent::blockingMapped<QList<MigrationResult>>(*project->mapNames, [this](const QString &map_name) {
+        return migrateMap(map_name);
+    });
+
+    int num_written = 0;
+    int num_failed = 0;
+    for (MigrationResult result : results) {
+        QString status = result.written ? "written" : "unchanged";
+        if (!result.ok) {
+            status = "failed";
+            num_failed++;
+        } else if (result.written) {
+            num_written++;
+        }
+        out << QString("%1\t%2 ms load\t%3 ms save\t%4\n")
+               .arg(result.map_name)
+               .arg(result.load_msecs)
+               .arg(result.save_msecs)
+               .arg(status);
+    }
+    out << QString("Migrated %1 maps (%2 written, %3 failed) in %4 ms\n")
+           .arg(results.length())
+           .arg(num_written)
+           .arg(num_failed)
+           .arg(timer.elapsed());
+
+    delete project;
+    project = NULL;
+    return num_failed ? 1 : 0;
+}
+
+// Runs on a worker thread.
+MigrationResult Migrator::migrateMap(QString map_name) {
+    MigrationResult result;
+    result.map_name = map_name;
+
+    QElapsedTimer timer;
+    timer.start();
+    Map *map = new Map;
+    map->name = map_name;
+    QStringList stages = project->getMapLoadStages();
+    // Saving doesn't touch tilesets, so don't spend time decoding them.
+    int tilesets_stage = stages.indexOf("tilesets");
+    for (int i = 0; i < stages.length(); i++) {
+        if (i == tilesets_stage) {
+            continue;
+        }
+        project->loadMapStage(map, i);
+    }
+    result.load_msecs = timer.restart();
+
+    // Nothing has been edited, so make it rewrite everything.
+    result.written = project->saveMap(map, true, &result.ok);
+    result.save_msecs = timer.elapsed();
+
+    delete map;
+    return result;
+}
@@ -0,0 +1,33 @@
+#ifndef MIGRATOR_H
+#define MIGRATOR_H
+
+#include "project.h"
+
+#include <QString>
+#include <QList>
+
+struct MigrationResult {
+    QString map_name;
+    qint64 load_msecs = 0;
+    qint64 save_msecs = 0;
+    bool written = false;
+    bool ok = true;
+};
+
+// Loads and re-saves every map in a project without a window,
+// so the whole tree can be brought up to date with the current macros.
+class Migrator
+{
+public:
+    Migrator(QString root_);
+
+public:
+    QString root;
+    int run();
+
+private:
+    Project *project = NULL;
+    MigrationResult migrateMap(QString map_name);
+};
+
+#endif // MIGRATOR_H
@@ -4,7 +4,7 @@
 #
 #-------------------------------------------------
 
-QT       += core gui
+QT       += core gui concurrent
 
 greaterThan(QT_MAJOR_VERSION, 4): QT += widgets
 
@@ -18,6 +18,7 @@ SOURCES += main.cpp\
     asm.cpp \
     map.cpp \
     blockdata.cpp \
+    blockdelta.cpp \
     block.cpp \
     tileset.cpp \
     metatile.cpp \
@@ -25,13 +26,22 @@ SOURCES += main.cpp\
     event.cpp \
     editor.cpp \
     objectpropertiesframe.cpp \
-    graphicsview.cpp
+    graphicsview.cpp \
+    maploader.cpp \
+    mapsaver.cpp \
+    projectcache.cpp \
+    sourcewatcher.cpp \
+    migrator.cpp \
+    trace.cpp \
+    cfile.cpp \
+    constants.cpp
 
 HEADERS  += mainwindow.h \
     project.h \
     asm.h \
     map.h \
     blockdata.h \
+    blockdelta.h \
     block.h \
     tileset.h \
     metatile.h \
@@ -39,10 +49,20 @@ HEADERS  += mainwindow.h \
     event.h \
     editor.h \
     objectpropertiesframe.h \
-    graphicsview.h
+    graphicsview.h \
+    maploader.h \
+    mapsaver.h \
+    projectcache.h \
+    sourcewatcher.h \
+    migrator.h \
+    trace.h \
+    cfile.h \
+    constants.h
 
 FORMS    += mainwindow.ui \
     objectpropertiesframe.ui
 
+win32: LIBS += -lpsapi
+
 RESOURCES += \
     resources/images.qrc
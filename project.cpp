@@ -4,13 +4,19 @@
 #include "tileset.h"
 #include "metatile.h"
 #include "event.h"
+#include "trace.h"
 
 #include <QDebug>
 #include <QFile>
-#include <QTextStream>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QMutexLocker>
+#include <QSet>
 #include <QMessageBox>
 #include <QRegularExpression>
 
+#include <algorithm>
+
 Project::Project()
 {
     groupNames = new QStringList;
@@ -18,6 +24,29 @@ Project::Project()
     mapNames = new QStringList;
     map_cache = new QMap<QString, Map*>;
     tileset_cache = new QMap<QString, Tileset*>;
+    asm_cache = new QMap<QString, QSharedPointer<AsmFile>>;
+    c_cache = new QMap<QString, QSharedPointer<CFile>>;
+    constants_cache = new QMap<QString, QSharedPointer<Constants>>;
+}
+
+// Nothing may still be loading or saving.
+Project::~Project()
+{
+    qDeleteAll(*map_cache);
+    for (Tileset *tileset : tileset_cache->values()) {
+        deleteTilesetContents(tileset);
+        delete tileset;
+    }
+    delete map_cache;
+    delete tileset_cache;
+    delete asm_cache;
+    delete c_cache;
+    delete constants_cache;
+    delete project_cache;
+    qDeleteAll(*groupedMapNames);
+    delete groupedMapNames;
+    delete groupNames;
+    delete mapNames;
 }
 
 QString Project::getProjectTitle() {
@@ -29,38 +58,232 @@ QString Project::getProjectTitle() {
 }
 
 Map* Project::loadMap(QString map_name) {
+    TRACE_SCOPE("Project::loadMap");
+    TRACE_ARG("map", map_name);
     Map *map = new Map;
 
     map->name = map_name;
-    readMapHeader(map);
-    readMapAttributes(map);
-    getTilesets(map);
-    loadBlockdata(map);
-    loadMapBorder(map);
-    readMapEvents(map);
-    loadMapConnections(map);
+    int num_stages = getMapLoadStages().length();
+    for (int i = 0; i < num_stages; i++) {
+        loadMapStage(map, i);
+    }
+    cacheMap(map);
+    trimCache();
+    return map;
+}
+
+QStringList Project::getMapLoadStages() {
+    QStringList stages;
+    stages << "header";
+    stages << "attributes";
+    stages << "tilesets";
+    stages << "blockdata";
+    stages << "border";
+    stages << "events";
+    stages << "connections";
+    return stages;
+}
+
+// Stages only touch the map they're given and the shared caches,
+// so they can run off the ui thread.
+// A map restored from the project cache skips the stages that parse asm.
+void Project::loadMapStage(Map *map, int stage) {
+    switch (stage) {
+    case 0:
+        if (!(project_cache && project_cache->restoreMap(map))) {
+            readMapHeader(map);
+        }
+        break;
+    case 1:
+        if (!map->from_cache) {
+            readMapAttributes(map);
+        }
+        break;
+    case 2: getTilesets(map); break;
+    case 3: loadBlockdata(map); break;
+    case 4: loadMapBorder(map); break;
+    case 5:
+        if (!map->from_cache) {
+            readMapEvents(map);
+        }
+        break;
+    case 6:
+        if (!map->from_cache) {
+            loadMapConnections(map);
+        }
+        break;
+    }
+}
+
+// map_cache belongs to the ui thread.
+void Project::cacheMap(Map *map) {
+    map->history.setMemoryLimit(history_budget);
     map->commit();
-    map->history.save();
+    map->markSaved();
+    map_cache->insert(map->name, map);
+    touchMap(map->name);
+    if (project_cache && !map->from_cache) {
+        project_cache->storeMap(map);
+    }
+}
 
-    map_cache->insert(map_name, map);
-    return map;
+void Project::touchMap(QString map_name) {
+    map_last_used.insert(map_name, ++map_clock);
+}
+
+// Tilesets are copied shallowly, so this is left to whoever owns the contents.
+void Project::deleteTilesetContents(Tileset *tileset) {
+    delete tileset->tiles;
+    if (tileset->metatiles) {
+        for (Metatile *metatile : *tileset->metatiles) {
+            delete metatile->tiles;
+            delete metatile;
+        }
+        delete tileset->metatiles;
+    }
+    delete tileset->palettes;
+    tileset->tiles = NULL;
+    tileset->metatiles = NULL;
+    tileset->palettes = NULL;
+}
+
+static void deleteTileset(Tileset *tileset) {
+    deleteTilesetContents(tileset);
+    delete tileset;
+}
+
+// Evicts the least recently used maps without unsaved changes, then tilesets no cached map uses,
+// until the caches fit in memory_budget. Anything evicted is loaded again the next time it's asked for.
+// Pinned maps are never evicted.
+void Project::trimCache() {
+    if (memory_budget <= 0) {
+        return;
+    }
+    TRACE_SCOPE("Project::trimCache");
+
+    QHash<QString, qint64> map_usage;
+    qint64 usage = 0;
+    for (QString map_name : map_cache->keys()) {
+        qint64 map_bytes = map_cache->value(map_name)->memoryUsage();
+        map_usage.insert(map_name, map_bytes);
+        usage += map_bytes;
+    }
+    QMap<QString, Tileset*> tilesets;
+    {
+        QMutexLocker locker(&cache_lock);
+        tilesets = *tileset_cache;
+    }
+    for (Tileset *tileset : tilesets.values()) {
+        usage += tileset->memoryUsage();
+    }
+    TRACE_ARG("kilobytes", (int)(usage / 1024));
+    if (usage <= memory_budget) {
+        return;
+    }
+
+    QStringList map_names = map_cache->keys();
+    std::sort(map_names.begin(), map_names.end(), [this](const QString &a, const QString &b) {
+        return map_last_used.value(a) < map_last_used.value(b);
+    });
+    int num_maps = 0;
+    for (QString map_name : map_names) {
+        if (usage <= memory_budget) {
+            break;
+        }
+        // The map used last is about to be handed to whoever asked for it.
+        if (map_last_used.value(map_name) == map_clock) {
+            continue;
+        }
+        Map *map = map_cache->value(map_name);
+        if (pinned_maps.contains(map_name) || map->hasUnsavedChanges()) {
+            continue;
+        }
+        usage -= map_usage.value(map_name);
+        map_cache->remove(map_name);
+        map_last_used.remove(map_name);
+        map->deleteLater();
+        num_maps++;
+    }
+
+    // Maps still loading may be holding tilesets that aren't in any cached map yet.
+    int num_tilesets = 0;
+    if (usage > memory_budget && loads_in_flight.loadAcquire() == 0) {
+        QSet<Tileset*> in_use;
+        for (Map *map : map_cache->values()) {
+            in_use.insert(map->tileset_primary);
+            in_use.insert(map->tileset_secondary);
+        }
+        QMutexLocker locker(&cache_lock);
+        for (QString label : tileset_cache->keys()) {
+            if (usage <= memory_budget) {
+                break;
+            }
+            Tileset *tileset = tileset_cache->value(label);
+            if (in_use.contains(tileset)) {
+                continue;
+            }
+            usage -= tileset->memoryUsage();
+            tileset_cache->remove(label);
+            deleteTileset(tileset);
+            num_tilesets++;
+        }
+    }
+    TRACE_ARG("evicted_maps", num_maps);
+    TRACE_ARG("evicted_tilesets", num_tilesets);
+}
+
+void Project::loadProjectCache() {
+    if (!project_cache) {
+        project_cache = new ProjectCache(root);
+    }
+    project_cache->load();
+}
+
+void Project::saveProjectCache() {
+    if (project_cache) {
+        project_cache->save();
+    }
+}
+
+// Sources are stamped as they're added, right before they're read,
+// so a change that lands after that makes the project cache entry stale instead of hiding it.
+static void addSourceStamp(QStringList *sources, QMap<QString, SourceStamp> *stamps, QString path) {
+    if (sources->contains(path)) {
+        return;
+    }
+    sources->append(path);
+    QFileInfo info(path);
+    if (info.exists()) {
+        stamps->insert(path, SourceStamp(info.lastModified().toMSecsSinceEpoch(), info.size()));
+    } else {
+        stamps->insert(path, SourceStamp(-1, -1));
+    }
+}
+
+void Project::addSource(Map *map, QString path) {
+    addSourceStamp(&map->sources, &map->source_stamps, path);
+}
+
+void Project::addSource(Tileset *tileset, QString path) {
+    addSourceStamp(&tileset->sources, &tileset->source_stamps, path);
 }
 
 void Project::loadMapConnections(Map *map) {
+    qDeleteAll(map->connections);
     map->connections.clear();
     if (!map->connections_label.isNull()) {
         QString path = root + QString("/data/maps/%1/connections.inc").arg(map->name);
-        QString text = readTextFile(path);
-        if (!text.isNull()) {
-            QList<QStringList> *commands = parse(text);
-            QStringList *list = getLabelValues(commands, map->connections_label);
+        addSource(map, path);
+        QSharedPointer<AsmFile> commands = getAsmFile(path);
+        if (commands) {
+            QStringList list = commands->getLabelValues(map->connections_label);
 
             //// Avoid using this value. It ought to be generated instead.
-            //int num_connections = list->value(0).toInt(nullptr, 0);
+            //int num_connections = list.value(0).toInt(nullptr, 0);
 
-            QString connections_list_label = list->value(1);
-            QList<QStringList> *connections = getLabelMacros(commands, connections_list_label);
-            for (QStringList command : *connections) {
+            QString connections_list_label = list.value(1);
+            QList<QStringList> connections = commands->getLabelMacros(connections_list_label);
+            for (QStringList command : connections) {
                 QString macro = command.value(0);
                 if (macro == "connection") {
                     Connection *connection = new Connection;
@@ -74,142 +297,191 @@ void Project::loadMapConnections(Map *map) {
     }
 }
 
-QList<QStringList>* Project::getLabelMacros(QList<QStringList> *list, QString label) {
-    bool in_label = false;
-    QList<QStringList> *new_list = new QList<QStringList>;
-    for (int i = 0; i < list->length(); i++) {
-        QStringList params = list->value(i);
-        QString macro = params.value(0);
-        if (macro == ".label") {
-            if (params.value(1) == label) {
-                in_label = true;
-            } else if (in_label) {
-                // If nothing has been read yet, assume the label
-                // we're looking for is in a stack of labels.
-                if (new_list->length() > 0) {
-                    break;
-                }
-            }
-        } else if (in_label) {
-            new_list->append(params);
-        }
-    }
-    return new_list;
-}
-
-// For if you don't care about filtering by macro,
-// and just want all values associated with some label.
-QStringList* Project::getLabelValues(QList<QStringList> *list, QString label) {
-    list = getLabelMacros(list, label);
-    QStringList *values = new QStringList;
-    for (int i = 0; i < list->length(); i++) {
-        QStringList params = list->value(i);
-        QString macro = params.value(0);
-        // Ignore .align
-        if (macro == ".align") {
-            continue;
-        }
-        for (int j = 1; j < params.length(); j++) {
-            values->append(params.value(j));
-        }
-    }
-    return values;
-}
-
 void Project::readMapHeader(Map* map) {
+    TRACE_SCOPE("Project::readMapHeader");
+    TRACE_ARG("map", map->name);
     QString label = map->name;
-    Asm *parser = new Asm;
 
-    QString header_text = readTextFile(root + "/data/maps/" + label + "/header.inc");
-    if (header_text.isNull()) {
+    QString header_path = root + "/data/maps/" + label + "/header.inc";
+    addSource(map, header_path);
+    QSharedPointer<AsmFile> header_file = getAsmFile(header_path);
+    if (!header_file) {
         return;
     }
-    QStringList *header = getLabelValues(parser->parse(header_text), label);
-    map->attributes_label = header->value(0);
-    map->events_label = header->value(1);
-    map->scripts_label = header->value(2);
-    map->connections_label = header->value(3);
-    map->song = header->value(4);
-    map->index = header->value(5);
-    map->location = header->value(6);
-    map->visibility = header->value(7);
-    map->weather = header->value(8);
-    map->type = header->value(9);
-    map->unknown = header->value(10);
-    map->show_location = header->value(11);
-    map->battle_scene = header->value(12);
-}
-
-void Project::saveMapHeader(Map *map) {
-    QString label = map->name;
-    QString header_path = root + "/data/maps/" + label + "/header.inc";
-    QString text = "";
-    text += QString("%1::\n").arg(label);
-    text += QString("\t.4byte %1\n").arg(map->attributes_label);
-    text += QString("\t.4byte %1\n").arg(map->events_label);
-    text += QString("\t.4byte %1\n").arg(map->scripts_label);
-    text += QString("\t.4byte %1\n").arg(map->connections_label);
-    text += QString("\t.2byte %1\n").arg(map->song);
-    text += QString("\t.2byte %1\n").arg(map->index);
-    text += QString("\t.byte %1\n").arg(map->location);
-    text += QString("\t.byte %1\n").arg(map->visibility);
-    text += QString("\t.byte %1\n").arg(map->weather);
-    text += QString("\t.byte %1\n").arg(map->type);
-    text += QString("\t.2byte %1\n").arg(map->unknown);
-    text += QString("\t.byte %1\n").arg(map->show_location);
-    text += QString("\t.byte %1\n").arg(map->battle_scene);
-    saveTextFile(header_path, text);
+    QStringList header = header_file->getLabelValues(label);
+    map->attributes_label = header.value(0);
+    map->events_label = header.value(1);
+    map->scripts_label = header.value(2);
+    map->connections_label = header.value(3);
+    map->song = header.value(4);
+    map->index = header.value(5);
+    map->location = header.value(6);
+    map->visibility = header.value(7);
+    map->weather = header.value(8);
+    map->type = header.value(9);
+    map->unknown = header.value(10);
+    map->show_location = header.value(11);
+    map->battle_scene = header.value(12);
 }
 
-void Project::readMapAttributes(Map* map) {
-    Asm *parser = new Asm;
+QByteArray Project::serializeMapHeader(const MapSnapshot &snapshot) {
+    const QStringList &values = snapshot.header_values;
+    AsmWriter text(512);
+    text.label(snapshot.map_name);
+    text.statement(".4byte", values.value(0)); // attributes
+    text.statement(".4byte", values.value(1)); // events
+    text.statement(".4byte", values.value(2)); // scripts
+    text.statement(".4byte", values.value(3)); // connections
+    text.statement(".2byte", values.value(4)); // song
+    text.statement(".2byte", values.value(5)); // index
+    text.statement(".byte", values.value(6)); // location
+    text.statement(".byte", values.value(7)); // visibility
+    text.statement(".byte", values.value(8)); // weather
+    text.statement(".byte", values.value(9)); // type
+    text.statement(".2byte", values.value(10)); // unknown
+    text.statement(".byte", values.value(11)); // show location
+    text.statement(".byte", values.value(12)); // battle scene
+    return text.data();
+}
 
-    QString assets_text = readTextFile(root + "/data/maps/_assets.inc");
-    if (assets_text.isNull()) {
+void Project::readMapAttributes(Map* map) {
+    QString assets_path = root + "/data/maps/_assets.inc";
+    addSource(map, assets_path);
+    QSharedPointer<AsmFile> assets = getAsmFile(assets_path);
+    if (!assets) {
         return;
     }
-    QStringList *attributes = getLabelValues(parser->parse(assets_text), map->attributes_label);
-    map->width = attributes->value(0);
-    map->height = attributes->value(1);
-    map->border_label = attributes->value(2);
-    map->blockdata_label = attributes->value(3);
-    map->tileset_primary_label = attributes->value(4);
-    map->tileset_secondary_label = attributes->value(5);
+    QStringList attributes = assets->getLabelValues(map->attributes_label);
+    map->width = attributes.value(0);
+    map->height = attributes.value(1);
+    map->border_label = attributes.value(2);
+    map->blockdata_label = attributes.value(3);
+    map->tileset_primary_label = attributes.value(4);
+    map->tileset_secondary_label = attributes.value(5);
 }
 
 void Project::getTilesets(Map* map) {
+    TRACE_SCOPE("Project::getTilesets");
+    TRACE_ARG("map", map->name);
     map->tileset_primary = getTileset(map->tileset_primary_label);
     map->tileset_secondary = getTileset(map->tileset_secondary_label);
 }
 
 Tileset* Project::loadTileset(QString label) {
-    Asm *parser = new Asm;
-
-    QString headers_text = readTextFile(root + "/data/tilesets/headers.inc");
-    QStringList *values = getLabelValues(parser->parse(headers_text), label);
     Tileset *tileset = new Tileset;
-    tileset->name = label;
-    tileset->is_compressed = values->value(0);
-    tileset->is_secondary = values->value(1);
-    tileset->padding = values->value(2);
-    tileset->tiles_label = values->value(3);
-    tileset->palettes_label = values->value(4);
-    tileset->metatiles_label = values->value(5);
-    tileset->metatile_attrs_label = values->value(6);
-    tileset->callback_label = values->value(7);
-
-    loadTilesetAssets(tileset);
+    readTileset(label, tileset);
 
+    QMutexLocker locker(&cache_lock);
+    if (tileset_cache->contains(label)) {
+        // Another thread loaded it first.
+        deleteTileset(tileset);
+        return tileset_cache->value(label);
+    }
     tileset_cache->insert(label, tileset);
     return tileset;
 }
 
+void Project::readTileset(QString label, Tileset *tileset) {
+    TRACE_SCOPE("Project::readTileset");
+    TRACE_ARG("tileset", label);
+    tileset->name = label;
+    tileset->sources.clear();
+    tileset->source_stamps.clear();
+
+    if (!(project_cache && project_cache->restoreTileset(label, tileset))) {
+        QString headers_path = root + "/data/tilesets/headers.inc";
+        addSource(tileset, headers_path);
+        QStringList values;
+        QSharedPointer<AsmFile> headers = getAsmFile(headers_path);
+        if (headers) {
+            values = headers->getLabelValues(label);
+        }
+        tileset->is_compressed = values.value(0);
+        tileset->is_secondary = values.value(1);
+        tileset->padding = values.value(2);
+        tileset->tiles_label = values.value(3);
+        tileset->palettes_label = values.value(4);
+        tileset->metatiles_label = values.value(5);
+        tileset->metatile_attrs_label = values.value(6);
+        tileset->callback_label = values.value(7);
+
+        loadTilesetAssets(tileset);
+
+        if (project_cache) {
+            project_cache->storeTileset(label, tileset);
+        }
+    }
+}
+
+// Re-reads a cached tileset in place, so maps using it pick up the changes.
+void Project::reloadTileset(QString label) {
+    Tileset *tileset;
+    {
+        QMutexLocker locker(&cache_lock);
+        tileset = tileset_cache->value(label, NULL);
+    }
+    if (tileset) {
+        Tileset fresh;
+        readTileset(label, &fresh);
+        deleteTilesetContents(tileset);
+        *tileset = fresh;
+    }
+}
+
+// Re-reads a cached map in place. The reload is committed as a saved state.
+void Project::reloadMap(Map *map) {
+    map->sources.clear();
+    map->source_stamps.clear();
+    map->from_cache = false;
+    map->blockdata_path = QString();
+    map->border_path = QString();
+    int num_stages = getMapLoadStages().length();
+    for (int i = 0; i < num_stages; i++) {
+        loadMapStage(map, i);
+    }
+    map->clearRenderCache();
+    map->commit();
+    map->markSaved();
+    if (project_cache && !map->from_cache) {
+        project_cache->storeMap(map);
+    }
+}
+
+// Remember what we wrote, so the file watcher can tell our own saves apart from outside changes.
+// The watcher can hear about a save before the thread doing it gets to recordWrite,
+// so the file is marked as ours from before it's replaced.
+void Project::expectWrite(QString path) {
+    QMutexLocker locker(&cache_lock);
+    written_files.insert(path, QDateTime());
+}
+
+void Project::recordWrite(QString path, bool written) {
+    QMutexLocker locker(&cache_lock);
+    if (written) {
+        written_files.insert(path, QFileInfo(path).lastModified());
+    } else {
+        written_files.remove(path);
+    }
+}
+
+bool Project::isOwnWrite(QString path) {
+    QMutexLocker locker(&cache_lock);
+    if (!written_files.contains(path)) {
+        return false;
+    }
+    QDateTime modified = written_files.value(path);
+    return modified.isNull() || modified == QFileInfo(path).lastModified();
+}
+
 QString Project::getBlockdataPath(Map* map) {
-    QString text = readTextFile(root + "/data/maps/_assets.inc");
-    QStringList *values = getLabelValues(parse(text), map->blockdata_label);
+    QStringList values;
+    QSharedPointer<AsmFile> assets = getAsmFile(root + "/data/maps/_assets.inc");
+    if (assets) {
+        values = assets->getLabelValues(map->blockdata_label);
+    }
     QString path;
-    if (!values->isEmpty()) {
-        path = root + "/" + values->value(0).section('"', 1, 1);
+    if (!values.isEmpty()) {
+        path = root + "/" + values.value(0).section('"', 1, 1);
     } else {
         path = root + "/data/maps/" + map->name + "/map.bin";
     }
@@ -217,11 +489,14 @@ QString Project::getBlockdataPath(Map* map) {
 }
 
 QString Project::getMapBorderPath(Map *map) {
-    QString text = readTextFile(root + "/data/maps/_assets.inc");
-    QStringList *values = getLabelValues(parse(text), map->border_label);
+    QStringList values;
+    QSharedPointer<AsmFile> assets = getAsmFile(root + "/data/maps/_assets.inc");
+    if (assets) {
+        values = assets->getLabelValues(map->border_label);
+    }
     QString path;
-    if (!values->isEmpty()) {
-        path = root + "/" + values->value(0).section('"', 1, 1);
+    if (!values.isEmpty()) {
+        path = root + "/" + values.value(0).section('"', 1, 1);
     } else {
         path = root + "/data/maps/" + map->name + "/border.bin";
     }
@@ -229,60 +504,142 @@ QString Project::getMapBorderPath(Map *map) {
 }
 
 void Project::loadBlockdata(Map* map) {
-    QString path = getBlockdataPath(map);
-    map->blockdata = readBlockdata(path);
+    TRACE_SCOPE("Project::loadBlockdata");
+    TRACE_ARG("map", map->name);
+    if (map->blockdata_path.isNull()) {
+        map->blockdata_path = getBlockdataPath(map);
+    }
+    delete map->blockdata;
+    map->blockdata = readBlockdata(map->blockdata_path);
+    TRACE_ARG("blocks", map->blockdata->length());
 }
 
 void Project::loadMapBorder(Map *map) {
-    QString path = getMapBorderPath(map);
-    map->border = readBlockdata(path);
+    if (map->border_path.isNull()) {
+        map->border_path = getMapBorderPath(map);
+    }
+    delete map->border;
+    map->border = readBlockdata(map->border_path);
 }
 
-void Project::saveBlockdata(Map* map) {
-    QString path = getBlockdataPath(map);
-    writeBlockdata(path, map->blockdata);
-    map->history.save();
+// Copies whatever needs saving, so it can be written on another thread while editing continues.
+// Only the parts that changed since the map was loaded or last saved are taken, unless force is set.
+// Runs on the thread that owns the map.
+MapSnapshot Project::snapshotMap(Map *map, bool force) {
+    MapSnapshot snapshot;
+    snapshot.map_name = map->name;
+    if (map->blockdata && (force || map->isBlockdataDirty())) {
+        snapshot.blockdata = true;
+        snapshot.blockdata_path = getBlockdataPath(map);
+        snapshot.blocks = map->blockdata->toVector();
+        snapshot.history_commit = map->history.currentId();
+    }
+    if (map->border && (force || map->isBorderDirty())) {
+        snapshot.border = true;
+        snapshot.border_path = getMapBorderPath(map);
+        snapshot.border_data = map->border->serialize();
+    }
+    if (force || map->isHeaderDirty()) {
+        snapshot.header = true;
+        snapshot.header_path = root + "/data/maps/" + map->name + "/header.inc";
+        snapshot.header_values = map->getHeaderValues();
+    }
+    if (force || map->isEventsDirty()) {
+        snapshot.events = true;
+        snapshot.events_path = root + QString("/data/maps/events/%1.inc").arg(map->name);
+        snapshot.event_values = map->getEventValues();
+        snapshot.events_label = map->events_label;
+        snapshot.object_events_label = map->object_events_label;
+        snapshot.warps_label = map->warps_label;
+        snapshot.coord_events_label = map->coord_events_label;
+        snapshot.bg_events_label = map->bg_events_label;
+    }
+    return snapshot;
 }
 
-void Project::writeBlockdata(QString path, Blockdata *blockdata) {
-    QFile file(path);
-    if (file.open(QIODevice::WriteOnly)) {
-        QByteArray data = blockdata->serialize();
-        file.write(data);
+// Safe to run on any thread.
+// Parts that fail to write are dropped from the snapshot, so they aren't marked saved.
+// Returns false if anything failed.
+bool Project::writeMapSnapshot(MapSnapshot *snapshot) {
+    TRACE_SCOPE("Project::writeMapSnapshot");
+    TRACE_ARG("map", snapshot->map_name);
+    bool ok = true;
+    bool part_ok = false;
+    if (snapshot->blockdata) {
+        snapshot->written |= writeFile(snapshot->blockdata_path, Blockdata::serialize(snapshot->blocks), &part_ok);
+        snapshot->blockdata = part_ok;
+        ok &= part_ok;
+    }
+    if (snapshot->border) {
+        snapshot->written |= writeFile(snapshot->border_path, snapshot->border_data, &part_ok);
+        snapshot->border = part_ok;
+        ok &= part_ok;
+    }
+    if (snapshot->header) {
+        snapshot->written |= writeFile(snapshot->header_path, serializeMapHeader(*snapshot), &part_ok);
+        snapshot->header = part_ok;
+        ok &= part_ok;
     }
+    if (snapshot->events) {
+        snapshot->written |= writeFile(snapshot->events_path, serializeMapEvents(*snapshot), &part_ok);
+        snapshot->events = part_ok;
+        ok &= part_ok;
+    }
+    return ok;
 }
 
-void Project::saveAllMaps() {
-    QList<QString> keys = map_cache->keys();
-    for (int i = 0; i < keys.length(); i++) {
-        QString key = keys.value(i);
-        Map* map = map_cache->value(key);
-        saveMap(map);
+// The map may have been edited since the snapshot was taken. Whatever changed since stays unsaved.
+void Project::markSnapshotSaved(Map *map, const MapSnapshot &snapshot) {
+    if (snapshot.blockdata) {
+        map->history.saveAt(snapshot.history_commit);
+    }
+    if (snapshot.border) {
+        map->saved_border = snapshot.border_data;
+    }
+    if (snapshot.header) {
+        map->saved_header_values = snapshot.header_values;
+    }
+    if (snapshot.events) {
+        map->saved_event_values = snapshot.event_values;
     }
 }
 
-void Project::saveMap(Map *map) {
-    saveBlockdata(map);
-    saveMapHeader(map);
-    saveMapEvents(map);
+// Returns true if any file was actually written. ok is set to false only if writing failed.
+// force saves every part of the map, edited or not, but files that already match are still left alone.
+bool Project::saveMap(Map *map, bool force, bool *ok) {
+    TRACE_SCOPE("Project::saveMap");
+    TRACE_ARG("map", map->name);
+    MapSnapshot snapshot = snapshotMap(map, force);
+    bool written_ok = writeMapSnapshot(&snapshot);
+    if (ok) {
+        *ok = written_ok;
+    }
+    markSnapshotSaved(map, snapshot);
+    return snapshot.written;
 }
 
 void Project::loadTilesetAssets(Tileset* tileset) {
-    Asm* parser = new Asm;
+    TRACE_SCOPE("Project::loadTilesetAssets");
+    TRACE_ARG("tileset", tileset->name);
     QString category = (tileset->is_secondary == "TRUE") ? "secondary" : "primary";
     if (tileset->name.isNull()) {
         return;
     }
     QString dir_path = root + "/data/tilesets/" + category + "/" + tileset->name.replace("gTileset_", "").toLower();
 
-    QString graphics_text = readTextFile(root + "/data/tilesets/graphics.inc");
-    QList<QStringList> *graphics = parser->parse(graphics_text);
-    QStringList *tiles_values = getLabelValues(graphics, tileset->tiles_label);
-    QStringList *palettes_values = getLabelValues(graphics, tileset->palettes_label);
+    QStringList tiles_values;
+    QStringList palettes_values;
+    QString graphics_path = root + "/data/tilesets/graphics.inc";
+    addSource(tileset, graphics_path);
+    QSharedPointer<AsmFile> graphics = getAsmFile(graphics_path);
+    if (graphics) {
+        tiles_values = graphics->getLabelValues(tileset->tiles_label);
+        palettes_values = graphics->getLabelValues(tileset->palettes_label);
+    }
 
     QString tiles_path;
-    if (!tiles_values->isEmpty()) {
-        tiles_path = root + "/" + tiles_values->value(0).section('"', 1, 1);
+    if (!tiles_values.isEmpty()) {
+        tiles_path = root + "/" + tiles_values.value(0).section('"', 1, 1);
     } else {
         tiles_path = dir_path + "/tiles.4bpp";
         if (tileset->is_compressed == "TRUE") {
@@ -290,47 +647,55 @@ void Project::loadTilesetAssets(Tileset* tileset) {
         }
     }
 
-    QStringList *palette_paths = new QStringList;
-    if (!palettes_values->isEmpty()) {
-        for (int i = 0; i < palettes_values->length(); i++) {
-            QString value = palettes_values->value(i);
-            palette_paths->append(root + "/" + value.section('"', 1, 1));
+    QStringList palette_paths;
+    if (!palettes_values.isEmpty()) {
+        for (int i = 0; i < palettes_values.length(); i++) {
+            QString value = palettes_values.value(i);
+            palette_paths.append(root + "/" + value.section('"', 1, 1));
         }
     } else {
         QString palettes_dir_path = dir_path + "/palettes";
         for (int i = 0; i < 16; i++) {
-            palette_paths->append(palettes_dir_path + "/" + QString("%1").arg(i, 2, 10, QLatin1Char('0')) + ".gbapal");
+            palette_paths.append(palettes_dir_path + "/" + QString("%1").arg(i, 2, 10, QLatin1Char('0')) + ".gbapal");
         }
     }
 
     QString metatiles_path;
     QString metatile_attrs_path;
-    QString metatiles_text = readTextFile(root + "/data/tilesets/metatiles.inc");
-    QList<QStringList> *metatiles_macros = parser->parse(metatiles_text);
-    QStringList *metatiles_values = getLabelValues(metatiles_macros, tileset->metatiles_label);
-    if (!metatiles_values->isEmpty()) {
-        metatiles_path = root + "/" + metatiles_values->value(0).section('"', 1, 1);
+    QStringList metatiles_values;
+    QStringList metatile_attrs_values;
+    QString metatiles_inc_path = root + "/data/tilesets/metatiles.inc";
+    addSource(tileset, metatiles_inc_path);
+    QSharedPointer<AsmFile> metatiles_macros = getAsmFile(metatiles_inc_path);
+    if (metatiles_macros) {
+        metatiles_values = metatiles_macros->getLabelValues(tileset->metatiles_label);
+        metatile_attrs_values = metatiles_macros->getLabelValues(tileset->metatile_attrs_label);
+    }
+    if (!metatiles_values.isEmpty()) {
+        metatiles_path = root + "/" + metatiles_values.value(0).section('"', 1, 1);
     } else {
         metatiles_path = dir_path + "/metatiles.bin";
     }
-    QStringList *metatile_attrs_values = getLabelValues(metatiles_macros, tileset->metatile_attrs_label);
-    if (!metatile_attrs_values->isEmpty()) {
-        metatile_attrs_path = root + "/" + metatile_attrs_values->value(0).section('"', 1, 1);
+    if (!metatile_attrs_values.isEmpty()) {
+        metatile_attrs_path = root + "/" + metatile_attrs_values.value(0).section('"', 1, 1);
     } else {
         metatile_attrs_path = dir_path + "/metatile_attributes.bin";
     }
 
     // tiles
     tiles_path = fixGraphicPath(tiles_path);
-    QImage *image = new QImage(tiles_path);
-    //image->setColor(0, qRgb(0xff, 0, 0)); // debug
+    addSource(tileset, tiles_path);
+    addSource(tileset, metatiles_path);
+    addSource(tileset, metatile_attrs_path);
+    QImage image(tiles_path);
+    //image.setColor(0, qRgb(0xff, 0, 0)); // debug
 
     QList<QImage> *tiles = new QList<QImage>;
     int w = 8;
     int h = 8;
-    for (int y = 0; y < image->height(); y += h)
-    for (int x = 0; x < image->width(); x += w) {
-        QImage tile = image->copy(x, y, w, h);
+    for (int y = 0; y < image.height(); y += h)
+    for (int x = 0; x < image.width(); x += w) {
+        QImage tile = image.copy(x, y, w, h);
         tiles->append(tile);
     }
     tileset->tiles = tiles;
@@ -380,10 +745,11 @@ void Project::loadTilesetAssets(Tileset* tileset) {
 
     // palettes
     QList<QList<QRgb>> *palettes = new QList<QList<QRgb>>;
-    for (int i = 0; i < palette_paths->length(); i++) {
-        QString path = palette_paths->value(i);
+    for (int i = 0; i < palette_paths.length(); i++) {
+        QString path = palette_paths.value(i);
         // the palettes are not compressed. this should never happen. it's only a precaution.
         path = path.replace(QRegExp("\\.lz$"), "");
+        addSource(tileset, path);
         // TODO default to .pal (JASC-PAL)
         // just use .gbapal for now
         QFile file(path);
@@ -415,18 +781,95 @@ Blockdata* Project::readBlockdata(QString path) {
     Blockdata *blockdata = new Blockdata;
     //qDebug() << path;
     QFile file(path);
-    if (file.open(QIODevice::ReadOnly)) {
-        QByteArray data = file.readAll();
-        for (int i = 0; (i + 1) < data.length(); i += 2) {
-            uint16_t word = (data[i] & 0xff) + ((data[i + 1] & 0xff) << 8);
-            blockdata->addBlock(word);
-        }
+    if (!file.open(QIODevice::ReadOnly)) {
+        qDebug() << QString("Could not open '%1'").arg(path);
+    } else if (!blockdata->read(&file)) {
+        qDebug() << QString("Could not read all of '%1'").arg(path);
     }
     return blockdata;
 }
 
+// Parsed files are kept until they change on disk.
+QSharedPointer<AsmFile> Project::getAsmFile(QString path) {
+    QFileInfo info(path);
+    if (!info.exists()) {
+        qDebug() << QString("Could not open '%1'").arg(path);
+        return QSharedPointer<AsmFile>();
+    }
+    QDateTime modified = info.lastModified();
+    {
+        QMutexLocker locker(&cache_lock);
+        QSharedPointer<AsmFile> cached = asm_cache->value(path);
+        if (cached && cached->modified == modified && cached->text.length() == info.size()) {
+            return cached;
+        }
+    }
+
+    // Parse outside the lock. Anyone still holding the old file keeps it alive.
+    QByteArray text = readFile(path);
+    if (text.isNull()) {
+        return QSharedPointer<AsmFile>();
+    }
+    QSharedPointer<AsmFile> asm_file(new AsmFile(text));
+    asm_file->path = path;
+    asm_file->modified = modified;
+    QMutexLocker locker(&cache_lock);
+    asm_cache->insert(path, asm_file);
+    return asm_file;
+}
+
+// Like getAsmFile, for C sources.
+QSharedPointer<CFile> Project::getCFile(QString path) {
+    QFileInfo info(path);
+    if (!info.exists()) {
+        qDebug() << QString("Could not open '%1'").arg(path);
+        return QSharedPointer<CFile>();
+    }
+    QDateTime modified = info.lastModified();
+    {
+        QMutexLocker locker(&cache_lock);
+        QSharedPointer<CFile> cached = c_cache->value(path);
+        if (cached && cached->modified == modified && cached->text.length() == info.size()) {
+            return cached;
+        }
+    }
+
+    QByteArray text = readFile(path);
+    if (text.isNull()) {
+        return QSharedPointer<CFile>();
+    }
+    QSharedPointer<CFile> c_file(new CFile(text));
+    c_file->path = path;
+    c_file->modified = modified;
+    QMutexLocker locker(&cache_lock);
+    c_cache->insert(path, c_file);
+    return c_file;
+}
+
+// Rebuilt only when getAsmFile() hands back a different file, which means it changed on disk.
+QSharedPointer<Constants> Project::getConstants(QString path) {
+    QSharedPointer<AsmFile> file = getAsmFile(path);
+    if (!file) {
+        return QSharedPointer<Constants>();
+    }
+    {
+        QMutexLocker locker(&cache_lock);
+        QSharedPointer<Constants> cached = constants_cache->value(path);
+        if (cached && cached->source == file) {
+            return cached;
+        }
+    }
+
+    QSharedPointer<Constants> constants(new Constants(file->commands));
+    constants->source = file;
+    QMutexLocker locker(&cache_lock);
+    constants_cache->insert(path, constants);
+    return constants;
+}
+
 Map* Project::getMap(QString map_name) {
     if (map_cache->contains(map_name)) {
+        touchMap(map_name);
         return map_cache->value(map_name);
     } else {
         Map *map = loadMap(map_name);
@@ -435,45 +878,89 @@ Map* Project::getMap(QString map_name) {
 }
 
 Tileset* Project::getTileset(QString label) {
-    if (tileset_cache->contains(label)) {
-        return tileset_cache->value(label);
-    } else {
-        Tileset *tileset = loadTileset(label);
-        return tileset;
+    {
+        QMutexLocker locker(&cache_lock);
+        if (tileset_cache->contains(label)) {
+            return tileset_cache->value(label);
+        }
     }
+    Tileset *tileset = loadTileset(label);
+    return tileset;
 }
 
-QString Project::readTextFile(QString path) {
+// Reads the whole file in one go. Returns a null QByteArray if it can't be opened.
+QByteArray Project::readFile(QString path) {
     QFile file(path);
     if (!file.open(QIODevice::ReadOnly)) {
         //QMessageBox::information(0, "Error", QString("Could not open '%1': ").arg(path) + file.errorString());
         qDebug() << QString("Could not open '%1': ").arg(path) + file.errorString();
+        return QByteArray();
+    }
+    QByteArray data = file.readAll();
+    if (data.isNull()) {
+        data = QByteArray("");
+    }
+    return data;
+}
+
+// Line endings come back as \n, the way QTextStream::readLine used to hand them over,
+// so a project checked out with CRLF doesn't leave \r on the end of values.
+// The tokenizers work on readFile's bytes and treat \r as whitespace themselves.
+QString Project::readTextFile(QString path) {
+    QByteArray data = readFile(path);
+    if (data.isNull()) {
         return QString();
     }
-    QTextStream in(&file);
-    QString text = "";
-    while (!in.atEnd()) {
-        text += in.readLine() + "\n";
+    if (data.contains('\r')) {
+        data.replace("\r\n", "\n");
+        data.replace('\r', '\n');
     }
-    return text;
+    return QString::fromUtf8(data.constData(), data.length());
 }
 
-void Project::saveTextFile(QString path, QString text) {
-    QFile file(path);
-    if (file.open(QIODevice::WriteOnly)) {
-        file.write(text.toUtf8());
-    } else {
+// Files that already have the same contents are left alone, so their mtime doesn't change.
+// Returns true if the file was written. ok is set to false only if writing failed.
+// The data goes to a temporary file that replaces the old one once it's complete,
+// so a crash or a full disk mid-save never leaves a truncated file behind.
+bool Project::writeFile(QString path, QByteArray data, bool *ok) {
+    if (ok) {
+        *ok = true;
+    }
+    if (QFileInfo(path).exists() && readFile(path) == data) {
+        return false;
+    }
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
         qDebug() << QString("Could not open '%1' for writing: ").arg(path) + file.errorString();
+        if (ok) {
+            *ok = false;
+        }
+        return false;
+    }
+    file.write(data);
+    expectWrite(path);
+    if (!file.commit()) {
+        qDebug() << QString("Could not write '%1': ").arg(path) + file.errorString();
+        recordWrite(path, false);
+        if (ok) {
+            *ok = false;
+        }
+        return false;
     }
+    recordWrite(path);
+    return true;
+}
+
+bool Project::saveTextFile(QString path, QString text) {
+    return writeFile(path, text.toUtf8());
 }
 
 void Project::readMapGroups() {
-    QString text = readTextFile(root + "/data/maps/_groups.inc");
-    if (text.isNull()) {
+    QSharedPointer<AsmFile> groups_file = getAsmFile(root + "/data/maps/_groups.inc");
+    if (!groups_file) {
         return;
     }
-    Asm *parser = new Asm;
-    QList<QStringList> *commands = parser->parse(text);
+    QList<QStringList> *commands = &groups_file->commands;
 
     bool in_group_pointers = false;
     QStringList *groups = new QStringList;
@@ -520,16 +1007,15 @@ void Project::readMapGroups() {
         }
     }
 
+    delete groupNames;
+    qDeleteAll(*groupedMapNames);
+    delete groupedMapNames;
+    delete mapNames;
     groupNames = groups;
     groupedMapNames = groupedMaps;
     mapNames = maps;
 }
 
-QList<QStringList>* Project::parse(QString text) {
-    Asm *parser = new Asm;
-    return parser->parse(text);
-}
-
 QStringList Project::getLocations() {
     // TODO
     QStringList names;
@@ -576,54 +1062,27 @@ QStringList Project::getBattleScenes() {
 }
 
 QStringList Project::getSongNames() {
-    QStringList names;
-    QString text = readTextFile(root + "/constants/songs.inc");
-    if (!text.isNull()) {
-        QList<QStringList> *commands = parse(text);
-        for (int i = 0; i < commands->length(); i++) {
-            QStringList params = commands->value(i);
-            QString macro = params.value(0);
-            if (macro == ".equiv") {
-                names.append(params.value(1));
-            }
-        }
+    QSharedPointer<Constants> songs = getConstants(root + "/constants/songs.inc");
+    if (!songs) {
+        return QStringList();
     }
-    return names;
+    return songs->names;
 }
 
 QString Project::getSongName(int value) {
-    QStringList names;
-    QString text = readTextFile(root + "/constants/songs.inc");
-    if (!text.isNull()) {
-        QList<QStringList> *commands = parse(text);
-        for (int i = 0; i < commands->length(); i++) {
-            QStringList params = commands->value(i);
-            QString macro = params.value(0);
-            if (macro == ".equiv") {
-                if (value == ((QString)(params.value(2))).toInt(nullptr, 0)) {
-                    return params.value(1);
-                }
-            }
-        }
+    QSharedPointer<Constants> songs = getConstants(root + "/constants/songs.inc");
+    if (!songs) {
+        return "";
     }
-    return "";
+    return songs->name(value);
 }
 
 QMap<QString, int> Project::getMapObjGfxConstants() {
     QMap<QString, int> constants;
-    QString text = readTextFile(root + "/constants/map_object_constants.inc");
-    if (!text.isNull()) {
-        QList<QStringList> *commands = parse(text);
-        for (int i = 0; i < commands->length(); i++) {
-            QStringList params = commands->value(i);
-            QString macro = params.value(0);
-            if (macro == ".set") {
-                QString constant = params.value(1);
-                if (constant.startsWith("MAP_OBJ_GFX_")) {
-                    int value = params.value(2).toInt(nullptr, 0);
-                    constants.insert(constant, value);
-                }
-            }
+    QSharedPointer<Constants> map_object_constants = getConstants(root + "/constants/map_object_constants.inc");
+    if (map_object_constants) {
+        for (QString constant : map_object_constants->namesWithPrefix("MAP_OBJ_GFX_")) {
+            constants.insert(constant, map_object_constants->value(constant));
         }
     }
     return constants;
@@ -636,6 +1095,8 @@ QString Project::fixGraphicPath(QString path) {
 }
 
 void Project::loadObjectPixmaps(QList<Event*> objects) {
+    TRACE_SCOPE("Project::loadObjectPixmaps");
+    TRACE_ARG("objects", objects.length());
     bool needs_update = false;
     for (Event *object : objects) {
         if (object->pixmap.isNull()) {
@@ -647,164 +1108,246 @@ void Project::loadObjectPixmaps(QList<Event*> objects) {
         return;
     }
 
-    QMap<QString, int> constants = getMapObjGfxConstants();
-
-    QString pointers_text = readTextFile(root + "/include/data/field_map_obj/map_object_graphics_info_pointers.h");
-    QString info_text = readTextFile(root + "/include/data/field_map_obj/map_object_graphics_info.h");
-    QString pic_text = readTextFile(root + "/include/data/field_map_obj/map_object_pic_tables.h");
-    QString assets_text = readTextFile(root + "/src/field/field_map_obj.c");
-
-    QStringList pointers = readCArray(pointers_text, "gMapObjectGraphicsInfoPointers");
+    bool have_sprites = updateSpriteSources();
 
     for (Event *object : objects) {
         if (!object->pixmap.isNull()) {
             continue;
         }
         QString event_type = object->get("event_type");
-        if (event_type == "object") {
-            object->pixmap = QPixmap(":/images/Entities_16x16.png").copy(0, 0, 16, 16);
-        } else if (event_type == "warp") {
-            object->pixmap = QPixmap(":/images/Entities_16x16.png").copy(16, 0, 16, 16);
-        } else if (event_type == "trap") {
-            object->pixmap = QPixmap(":/images/Entities_16x16.png").copy(32, 0, 16, 16);
-        } else if (event_type == "sign" || event_type == "hidden item") {
-            object->pixmap = QPixmap(":/images/Entities_16x16.png").copy(48, 0, 16, 16);
+        if (event_type == "object" && have_sprites) {
+            object->pixmap = getObjectSprite(object->get("sprite"));
         }
+        if (object->pixmap.isNull()) {
+            object->pixmap = getEventPlaceholder(event_type);
+        }
+    }
 
-        if (event_type == "object") {
+}
 
-            int sprite_id = constants.value(object->get("sprite"));
+// Drops the sprite cache if any of the files sprites are resolved from have changed.
+// Returns false if any of them are missing.
+bool Project::updateSpriteSources() {
+    QSharedPointer<AsmFile> constants_file = getAsmFile(root + "/constants/map_object_constants.inc");
+    QList<QSharedPointer<CFile>> files;
+    files << getCFile(root + "/include/data/field_map_obj/map_object_graphics_info_pointers.h");
+    files << getCFile(root + "/include/data/field_map_obj/map_object_graphics_info.h");
+    files << getCFile(root + "/include/data/field_map_obj/map_object_pic_tables.h");
+    files << getCFile(root + "/src/field/field_map_obj.c");
+
+    if (constants_file != sprite_constants_file || files != sprite_files) {
+        sprite_cache.clear();
+        sprite_constants_file = constants_file;
+        sprite_files = files;
+    }
 
-            QString info_label = pointers.value(sprite_id).replace("&", "");
-            QString pic_label = readCArray(info_text, info_label).value(14);
-            QString gfx_label = readCArray(pic_text, pic_label).value(0);
-            gfx_label = gfx_label.section(QRegExp("[\\(\\)]"), 1, 1);
-            QString path = readCIncbin(assets_text, gfx_label);
+    if (!constants_file) {
+        return false;
+    }
+    for (QSharedPointer<CFile> file : files) {
+        if (!file) {
+            return false;
+        }
+    }
+    return true;
+}
 
-            if (!path.isNull()) {
-                path = fixGraphicPath(path);
-                QPixmap pixmap(root + "/" + path);
-                if (!pixmap.isNull()) {
-                    object->pixmap = pixmap;
-                }
-            }
+// Expects updateSpriteSources() to have succeeded.
+QPixmap Project::getObjectSprite(QString sprite) {
+    if (sprite_cache.contains(sprite)) {
+        return sprite_cache.value(sprite);
+    }
+    CFile *pointers_file = sprite_files.value(0).data();
+    CFile *info_file = sprite_files.value(1).data();
+    CFile *pic_file = sprite_files.value(2).data();
+    CFile *assets_file = sprite_files.value(3).data();
+
+    QSharedPointer<Constants> constants = getConstants(sprite_constants_file->path);
+    int sprite_id = constants ? constants->value(sprite) : 0;
+    QString info_label = pointers_file->getArray("gMapObjectGraphicsInfoPointers").value(sprite_id).replace("&", "");
+    QString pic_label = info_file->getArray(info_label).value(14);
+    QString gfx_label = pic_file->getArray(pic_label).value(0);
+    gfx_label = gfx_label.section(QRegExp("[\\(\\)]"), 1, 1);
+    QString path = assets_file->getIncbin(gfx_label);
+
+    QPixmap pixmap;
+    if (!path.isNull()) {
+        path = fixGraphicPath(path);
+        pixmap = QPixmap(root + "/" + path);
+    }
+    sprite_cache.insert(sprite, pixmap);
+    return pixmap;
+}
 
+QPixmap Project::getEventPlaceholder(QString event_type) {
+    if (placeholder_cache.contains(event_type)) {
+        return placeholder_cache.value(event_type);
+    }
+    int x = -1;
+    if (event_type == "object") {
+        x = 0;
+    } else if (event_type == "warp") {
+        x = 16;
+    } else if (event_type == "trap") {
+        x = 32;
+    } else if (event_type == "sign" || event_type == "hidden item") {
+        x = 48;
+    }
+    QPixmap pixmap;
+    if (x >= 0) {
+        if (entities_pixmap.isNull()) {
+            entities_pixmap = QPixmap(":/images/Entities_16x16.png");
         }
+        pixmap = entities_pixmap.copy(x, 0, 16, 16);
     }
-
+    placeholder_cache.insert(event_type, pixmap);
+    return pixmap;
 }
 
-void Project::saveMapEvents(Map *map) {
-    QString path = root + QString("/data/maps/events/%1.inc").arg(map->name);
-    QString text = "";
-
-    text += QString("%1::\n").arg(map->object_events_label);
-    for (int i = 0; i < map->events["object"].length(); i++) {
-        Event *object_event = map->events["object"].value(i);
-        int radius_x = object_event->getInt("radius_x");
-        int radius_y = object_event->getInt("radius_y");
-        QString radius = QString("%1").arg((radius_x & 0xf) + ((radius_y & 0xf) << 4));
-        uint16_t x = object_event->getInt("x");
-        uint16_t y = object_event->getInt("y");
-
-        text += QString("\tobject_event %1").arg(i + 1);
-        text += QString(", %1").arg(object_event->get("sprite"));
-        text += QString(", %1").arg(object_event->get("replacement"));
-        text += QString(", %1").arg(x & 0xff);
-        text += QString(", %1").arg((x >> 8) & 0xff);
-        text += QString(", %1").arg(y & 0xff);
-        text += QString(", %1").arg((y >> 8) & 0xff);
-        text += QString(", %1").arg(object_event->get("elevation"));
-        text += QString(", %1").arg(object_event->get("behavior"));
-        text += QString(", %1").arg(radius);
-        text += QString(", 0");
-        text += QString(", %1").arg(object_event->get("property"));
-        text += QString(", 0");
-        text += QString(", %1").arg(object_event->get("sight_radius"));
-        text += QString(", 0");
-        text += QString(", %1").arg(object_event->get("script_label"));
-        text += QString(", %1").arg(object_event->get("event_flag"));
-        text += QString(", 0");
-        text += QString(", 0");
-        text += "\n";
-    }
-    text += "\n";
-
-    text += QString("%1::\n").arg(map->warps_label);
-    for (Event *warp : map->events["warp"]) {
-        text += QString("\twarp_def %1").arg(warp->get("x"));
-        text += QString(", %1").arg(warp->get("y"));
-        text += QString(", %1").arg(warp->get("elevation"));
-        text += QString(", %1").arg(warp->get("destination_warp"));
-        text += QString(", %1").arg(warp->get("destination_map"));
-        text += "\n";
-    }
-    text += "\n";
-
-    text += QString("%1::\n").arg(map->coord_events_label);
-    for (Event *coords : map->events["trap"]) {
-        text += QString("\tcoord_event %1").arg(coords->get("x"));
-        text += QString(", %1").arg(coords->get("y"));
-        text += QString(", %1").arg(coords->get("elevation"));
-        text += QString(", 0");
-        text += QString(", %1").arg(coords->get("coord_unknown1"));
-        text += QString(", %1").arg(coords->get("coord_unknown2"));
-        text += QString(", 0");
-        text += QString(", %1").arg(coords->get("script_label"));
-        text += "\n";
-    }
-    text += "\n";
-
-    text += QString("%1::\n").arg(map->bg_events_label);
-    for (Event *sign : map->events["sign"]) {
-        text += QString("\tbg_event %1").arg(sign->get("x"));
-        text += QString(", %1").arg(sign->get("y"));
-        text += QString(", %1").arg(sign->get("elevation"));
-        text += QString(", %1").arg(sign->get("type"));
-        text += QString(", 0");
-        text += QString(", %1").arg(sign->get("script_label"));
-        text += "\n";
-    }
-    for (Event *item : map->events["hidden item"]) {
-        text += QString("\tbg_event %1").arg(item->get("x"));
-        text += QString(", %1").arg(item->get("y"));
-        text += QString(", %1").arg(item->get("elevation"));
-        text += QString(", %1").arg(item->get("type"));
-        text += QString(", 0");
-        text += QString(", %1").arg(item->get("item"));
-        text += QString(", %1").arg(item->get("item_unknown5"));
-        text += QString(", %1").arg(item->get("item_unknown6"));
-        text += "\n";
-    }
-    text += "\n";
-
-    text += QString("%1::\n").arg(map->events_label);
-    text += QString("\tmap_events %1, %2, %3, %4\n")
-            .arg(map->object_events_label)
-            .arg(map->warps_label)
-            .arg(map->coord_events_label)
-            .arg(map->bg_events_label);
-
-    saveTextFile(path, text);
+QByteArray Project::serializeMapEvents(const MapSnapshot &snapshot) {
+    QList<QMap<QString, QString>> objects;
+    QList<QMap<QString, QString>> warps;
+    QList<QMap<QString, QString>> coords;
+    QList<QMap<QString, QString>> bgs;
+    QList<QMap<QString, QString>> hidden_items;
+    for (const QMap<QString, QString> &event : snapshot.event_values) {
+        QString event_type = event.value("event_type");
+        if (event_type == "object") {
+            objects.append(event);
+        } else if (event_type == "warp") {
+            warps.append(event);
+        } else if (event_type == "trap") {
+            coords.append(event);
+        } else if (event_type == "sign") {
+            bgs.append(event);
+        } else if (event_type == "hidden item") {
+            hidden_items.append(event);
+        }
+    }
+    auto getInt = [](const QMap<QString, QString> &event, QString key) {
+        return event.value(key).toInt(nullptr, 0);
+    };
+
+    // Object events are the longest lines, at around 100 bytes.
+    AsmWriter text(1024 + snapshot.event_values.length() * 128);
+
+    text.label(snapshot.object_events_label);
+    for (int i = 0; i < objects.length(); i++) {
+        const QMap<QString, QString> &object_event = objects.at(i);
+        int radius_x = getInt(object_event, "radius_x");
+        int radius_y = getInt(object_event, "radius_y");
+        int radius = (radius_x & 0xf) + ((radius_y & 0xf) << 4);
+        uint16_t x = getInt(object_event, "x");
+        uint16_t y = getInt(object_event, "y");
+
+        text.macro("object_event");
+        text.arg(i + 1);
+        text.arg(object_event.value("sprite"));
+        text.arg(object_event.value("replacement"));
+        text.arg(x & 0xff);
+        text.arg((x >> 8) & 0xff);
+        text.arg(y & 0xff);
+        text.arg((y >> 8) & 0xff);
+        text.arg(object_event.value("elevation"));
+        text.arg(object_event.value("behavior"));
+        text.arg(radius);
+        text.arg(0);
+        text.arg(object_event.value("property"));
+        text.arg(0);
+        text.arg(object_event.value("sight_radius"));
+        text.arg(0);
+        text.arg(object_event.value("script_label"));
+        text.arg(object_event.value("event_flag"));
+        text.arg(0);
+        text.arg(0);
+        text.end();
+    }
+    text.newline();
+
+    text.label(snapshot.warps_label);
+    for (const QMap<QString, QString> &warp : warps) {
+        text.macro("warp_def");
+        text.arg(warp.value("x"));
+        text.arg(warp.value("y"));
+        text.arg(warp.value("elevation"));
+        text.arg(warp.value("destination_warp"));
+        text.arg(warp.value("destination_map"));
+        text.end();
+    }
+    text.newline();
+
+    text.label(snapshot.coord_events_label);
+    for (const QMap<QString, QString> &coords_event : coords) {
+        text.macro("coord_event");
+        text.arg(coords_event.value("x"));
+        text.arg(coords_event.value("y"));
+        text.arg(coords_event.value("elevation"));
+        text.arg(0);
+        text.arg(coords_event.value("coord_unknown1"));
+        text.arg(coords_event.value("coord_unknown2"));
+        text.arg(0);
+        text.arg(coords_event.value("script_label"));
+        text.end();
+    }
+    text.newline();
+
+    text.label(snapshot.bg_events_label);
+    for (const QMap<QString, QString> &sign : bgs) {
+        text.macro("bg_event");
+        text.arg(sign.value("x"));
+        text.arg(sign.value("y"));
+        text.arg(sign.value("elevation"));
+        text.arg(sign.value("type"));
+        text.arg(0);
+        text.arg(sign.value("script_label"));
+        text.end();
+    }
+    for (const QMap<QString, QString> &item : hidden_items) {
+        text.macro("bg_event");
+        text.arg(item.value("x"));
+        text.arg(item.value("y"));
+        text.arg(item.value("elevation"));
+        text.arg(item.value("type"));
+        text.arg(0);
+        text.arg(item.value("item"));
+        text.arg(item.value("item_unknown5"));
+        text.arg(item.value("item_unknown6"));
+        text.end();
+    }
+    text.newline();
+
+    text.label(snapshot.events_label);
+    text.macro("map_events");
+    text.arg(snapshot.object_events_label);
+    text.arg(snapshot.warps_label);
+    text.arg(snapshot.coord_events_label);
+    text.arg(snapshot.bg_events_label);
+    text.end();
+
+    return text.data();
 }
 
 void Project::readMapEvents(Map *map) {
+    TRACE_SCOPE("Project::readMapEvents");
+    TRACE_ARG("map", map->name);
     // lazy
     QString path = root + QString("/data/maps/events/%1.inc").arg(map->name);
-    QString text = readTextFile(path);
-    if (text.isNull()) {
+    addSource(map, path);
+    QSharedPointer<AsmFile> commands = getAsmFile(path);
+    if (!commands) {
         return;
     }
 
-    QStringList *labels = getLabelValues(parse(text), map->events_label);
-    map->object_events_label = labels->value(0);
-    map->warps_label = labels->value(1);
-    map->coord_events_label = labels->value(2);
-    map->bg_events_label = labels->value(3);
+    QStringList labels = commands->getLabelValues(map->events_label);
+    map->object_events_label = labels.value(0);
+    map->warps_label = labels.value(1);
+    map->coord_events_label = labels.value(2);
+    map->bg_events_label = labels.value(3);
 
-    QList<QStringList> *object_events = getLabelMacros(parse(text), map->object_events_label);
+    QList<QStringList> object_events = commands->getLabelMacros(map->object_events_label);
+    qDeleteAll(map->events["object"]);
     map->events["object"].clear();
-    for (QStringList command : *object_events) {
+    for (QStringList command : object_events) {
         if (command.value(0) == "object_event") {
             Event *object = new Event;
             object->put("map_name", map->name);
@@ -846,9 +1389,10 @@ void Project::readMapEvents(Map *map) {
         }
     }
 
-    QList<QStringList> *warps = getLabelMacros(parse(text), map->warps_label);
+    QList<QStringList> warps = commands->getLabelMacros(map->warps_label);
+    qDeleteAll(map->events["warp"]);
     map->events["warp"].clear();
-    for (QStringList command : *warps) {
+    for (QStringList command : warps) {
         if (command.value(0) == "warp_def") {
             Event *warp = new Event;
             warp->put("map_name", map->name);
@@ -864,9 +1408,10 @@ void Project::readMapEvents(Map *map) {
         }
     }
 
-    QList<QStringList> *coords = getLabelMacros(parse(text), map->coord_events_label);
+    QList<QStringList> coords = commands->getLabelMacros(map->coord_events_label);
+    qDeleteAll(map->events["trap"]);
     map->events["trap"].clear();
-    for (QStringList command : *coords) {
+    for (QStringList command : coords) {
         if (command.value(0) == "coord_event") {
             Event *coord = new Event;
             coord->put("map_name", map->name);
@@ -891,10 +1436,12 @@ void Project::readMapEvents(Map *map) {
         }
     }
 
-    QList<QStringList> *bgs = getLabelMacros(parse(text), map->bg_events_label);
+    QList<QStringList> bgs = commands->getLabelMacros(map->bg_events_label);
+    qDeleteAll(map->events["hidden item"]);
     map->events["hidden item"].clear();
+    qDeleteAll(map->events["sign"]);
     map->events["sign"].clear();
-    for (QStringList command : *bgs) {
+    for (QStringList command : bgs) {
         if (command.value(0) == "bg_event") {
             Event *bg = new Event;
             bg->put("map_name", map->name);
@@ -922,50 +1469,3 @@ void Project::readMapEvents(Map *map) {
     }
 
 }
-
-QStringList Project::readCArray(QString text, QString label) {
-    QStringList list;
-
-    if (label.isNull()) {
-        return list;
-    }
-
-    QRegExp *re = new QRegExp(QString("\\b%1\\b\\s*\\[?\\s*\\]?\\s*=\\s*\\{([^\\}]*)\\}").arg(label));
-    int pos = re->indexIn(text);
-    if (pos != -1) {
-        QString body = re->cap(1);
-        body = body.replace(QRegExp("\\s*"), "");
-        list = body.split(',');
-        /*
-        QRegExp *inner = new QRegExp("&?\\b([A-Za-z0-9_\\(\\)]*)\\b,");
-        int pos = 0;
-        while ((pos = inner->indexIn(body, pos)) != -1) {
-            list << inner->cap(1);
-            pos += inner->matchedLength();
-        }
-        */
-    }
-
-    return list;
-}
-
-QString Project::readCIncbin(QString text, QString label) {
-    QString path;
-
-    if (label.isNull()) {
-        return path;
-    }
-
-    QRegExp *re = new QRegExp(QString(
-        "\\b%1\\b"
-        "\\s*\\[?\\s*\\]?\\s*=\\s*"
-        "INCBIN_[US][0-9][0-9]?"
-        "\\(\"([^\"]*)\"\\)").arg(label));
-
-    int pos = re->indexIn(text);
-    if (pos != -1) {
-        path = re->cap(1);
-    }
-
-    return path;
-}
@@ -3,14 +3,55 @@
 
 #include "map.h"
 #include "blockdata.h"
+#include "asm.h"
+#include "cfile.h"
+#include "constants.h"
+#include "projectcache.h"
 
 #include <QStringList>
 #include <QList>
+#include <QMutex>
+#include <QSharedPointer>
+#include <QAtomicInt>
+#include <QHash>
+#include <QPixmap>
+
+// A copy of the parts of a map that need saving, and where they go.
+// It doesn't point into the map, so it can be written while the map is being edited.
+class MapSnapshot
+{
+public:
+    QString map_name;
+    bool written = false;
+
+    bool blockdata = false;
+    QString blockdata_path;
+    QVector<uint16_t> blocks;
+    quint64 history_commit = 0;
+
+    bool border = false;
+    QString border_path;
+    QByteArray border_data;
+
+    bool header = false;
+    QString header_path;
+    QStringList header_values;
+
+    bool events = false;
+    QString events_path;
+    QList<QMap<QString, QString>> event_values;
+    QString events_label;
+    QString object_events_label;
+    QString warps_label;
+    QString coord_events_label;
+    QString bg_events_label;
+};
 
 class Project
 {
 public:
     Project();
+    ~Project();
     QString root;
     QStringList *groupNames = NULL;
     QList<QStringList*> *groupedMapNames = NULL;
@@ -19,35 +60,76 @@ public:
     QMap<QString, Map*> *map_cache;
     Map* loadMap(QString);
     Map* getMap(QString);
+    QStringList getMapLoadStages();
+    void loadMapStage(Map*, int stage);
+    void cacheMap(Map*);
+
+    // Cached maps and tilesets are evicted past this many bytes. 0 means no limit.
+    qint64 memory_budget = 0;
+    // Each map's undo history is trimmed to this many bytes. 0 means no limit.
+    qint64 history_budget = 0;
+    QStringList pinned_maps;
+    QHash<QString, quint64> map_last_used;
+    quint64 map_clock = 0;
+    QAtomicInt loads_in_flight;
+    void touchMap(QString map_name);
+    void trimCache();
 
     QMap<QString, Tileset*> *tileset_cache = NULL;
     Tileset* loadTileset(QString);
     Tileset* getTileset(QString);
+    static void deleteTilesetContents(Tileset *tileset);
+    void readTileset(QString label, Tileset *tileset);
+    void reloadTileset(QString label);
+    void reloadMap(Map *map);
+
+    QMap<QString, QDateTime> written_files;
+    void expectWrite(QString path);
+    void recordWrite(QString path, bool written = true);
+    bool isOwnWrite(QString path);
 
     Blockdata* readBlockdata(QString);
     void loadBlockdata(Map*);
 
+    ProjectCache *project_cache = NULL;
+    void loadProjectCache();
+    void saveProjectCache();
+    void addSource(Map *map, QString path);
+    void addSource(Tileset *tileset, QString path);
+
+    QMap<QString, QSharedPointer<AsmFile>> *asm_cache = NULL;
+    QSharedPointer<AsmFile> getAsmFile(QString path);
+
+    QMap<QString, QSharedPointer<CFile>> *c_cache = NULL;
+    QSharedPointer<CFile> getCFile(QString path);
+
+    QMap<QString, QSharedPointer<Constants>> *constants_cache = NULL;
+    QSharedPointer<Constants> getConstants(QString path);
+
+    // Guards tileset_cache, asm_cache, c_cache and constants_cache, which map loads share across threads.
+    QMutex cache_lock;
+
+    QByteArray readFile(QString path);
     QString readTextFile(QString path);
-    void saveTextFile(QString path, QString text);
+    bool writeFile(QString path, QByteArray data, bool *ok = NULL);
+    bool saveTextFile(QString path, QString text);
 
     void readMapGroups();
     QString getProjectTitle();
 
-    QList<QStringList>* getLabelMacros(QList<QStringList>*, QString);
-    QStringList* getLabelValues(QList<QStringList>*, QString);
     void readMapHeader(Map*);
     void readMapAttributes(Map*);
     void getTilesets(Map*);
     void loadTilesetAssets(Tileset*);
 
     QString getBlockdataPath(Map*);
-    void saveBlockdata(Map*);
-    void writeBlockdata(QString, Blockdata*);
-    void saveAllMaps();
-    void saveMap(Map*);
-    void saveMapHeader(Map*);
+    MapSnapshot snapshotMap(Map*, bool force = false);
+    bool writeMapSnapshot(MapSnapshot *snapshot);
+    void markSnapshotSaved(Map*, const MapSnapshot &snapshot);
+    QByteArray serializeMapHeader(const MapSnapshot &snapshot);
+    QByteArray serializeMapEvents(const MapSnapshot &snapshot);
+    bool saveMap(Map*, bool force = false, bool *ok = NULL);
 
-    QList<QStringList>* parse(QString text);
     QStringList getSongNames();
     QString getSongName(int);
     QStringList getLocations();
@@ -58,6 +140,16 @@ public:
 
     void loadObjectPixmaps(QList<Event*> objects);
     QMap<QString, int> getMapObjGfxConstants();
+    QPixmap getObjectSprite(QString sprite);
+    QPixmap getEventPlaceholder(QString event_type);
+    bool updateSpriteSources();
+
+    // Decoded once and shared by every event that shows them. UI thread only.
+    QMap<QString, QPixmap> sprite_cache; // MAP_OBJ_GFX_* -> sprite, null if it can't be found
+    QMap<QString, QPixmap> placeholder_cache; // event type -> placeholder
+    QPixmap entities_pixmap;
+    QSharedPointer<AsmFile> sprite_constants_file;
+    QList<QSharedPointer<CFile>> sprite_files;
     QString fixGraphicPath(QString path);
 
     void readMapEvents(Map *map);
@@ -65,11 +157,6 @@ public:
 
     void loadMapBorder(Map *map);
     QString getMapBorderPath(Map *map);
-
-    void saveMapEvents(Map *map);
-
-    QStringList readCArray(QString text, QString label);
-    QString readCIncbin(QString text, QString label);
 };
 
 #endif // PROJECT_H
@@ -0,0 +1,388 @@
+#include "projectcache.h"
+
+#include <QDataStream>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QCryptographicHash>
+#include <QMutexLocker>
+#include <QDebug>
+
+static const quint32 CACHE_MAGIC = 0x706d6170; // "pmap"
+static const quint32 CACHE_VERSION = 1;
+
+ProjectCache::ProjectCache(QString root_)
+{
+    root = root_;
+    QString dir = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+    QString hash = QCryptographicHash::hash(root.toUtf8(), QCryptographicHash::Sha1).toHex();
+    if (dir.isEmpty()) {
+        path = root + "/.pretmap_cache";
+    } else {
+        path = dir + "/projects/" + hash + ".cache";
+    }
+}
+
+void ProjectCache::load() {
+    QMutexLocker locker(&lock);
+    maps.clear();
+    tilesets.clear();
+    dirty = false;
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return;
+    }
+    QDataStream in(&file);
+    in.setVersion(QDataStream::Qt_5_0);
+    quint32 magic, version;
+    in >> magic >> version;
+    if (magic != CACHE_MAGIC || version != CACHE_VERSION) {
+        qDebug() << QString("Ignoring out of date cache '%1'").arg(path);
+        return;
+    }
+    in >> maps >> tilesets;
+    if (in.status() != QDataStream::Ok) {
+        qDebug() << QString("Ignoring corrupt cache '%1'").arg(path);
+        maps.clear();
+        tilesets.clear();
+    }
+}
+
+void ProjectCache::save() {
+    QMutexLocker locker(&lock);
+    if (!dirty) {
+        return;
+    }
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << QString("Could not open '%1' for writing: ").arg(path) + file.errorString();
+        return;
+    }
+    QDataStream out(&file);
+    out.setVersion(QDataStream::Qt_5_0);
+    out << CACHE_MAGIC << CACHE_VERSION;
+    out << maps << tilesets;
+    if (file.commit()) {
+        dirty = false;
+    }
+}
+
+// Sources are stored with their mtime and size from when they were read, not when the entry is written,
+// so a change in between still shows up. A source without a stamp never matches.
+static void writeSources(QDataStream &out, QStringList sources, QMap<QString, SourceStamp> stamps) {
+    out << (quint32)sources.length();
+    for (QString source : sources) {
+        SourceStamp stamp = stamps.value(source, SourceStamp(-2, -2));
+        out << source << stamp.first << stamp.second;
+    }
+}
+
+// Returns false if any source has changed since.
+static bool readSources(QDataStream &in, QStringList *sources, QMap<QString, SourceStamp> *stamps) {
+    quint32 count = 0;
+    in >> count;
+    bool fresh = true;
+    for (quint32 i = 0; i < count && in.status() == QDataStream::Ok; i++) {
+        QString source;
+        qint64 modified, size;
+        in >> source >> modified >> size;
+        QFileInfo info(source);
+        if (info.exists()) {
+            if (info.lastModified().toMSecsSinceEpoch() != modified || info.size() != size) {
+                fresh = false;
+            }
+        } else if (modified != -1) {
+            fresh = false;
+        }
+        sources->append(source);
+        stamps->insert(source, SourceStamp(modified, size));
+    }
+    return fresh && in.status() == QDataStream::Ok;
+}
+
+static QList<QString*> getMapFields(Map *map) {
+    QList<QString*> fields;
+    fields << &map->attributes_label;
+    fields << &map->events_label;
+    fields << &map->scripts_label;
+    fields << &map->connections_label;
+    fields << &map->song;
+    fields << &map->index;
+    fields << &map->location;
+    fields << &map->visibility;
+    fields << &map->weather;
+    fields << &map->type;
+    fields << &map->unknown;
+    fields << &map->show_location;
+    fields << &map->battle_scene;
+    fields << &map->width;
+    fields << &map->height;
+    fields << &map->border_label;
+    fields << &map->blockdata_label;
+    fields << &map->tileset_primary_label;
+    fields << &map->tileset_secondary_label;
+    fields << &map->object_events_label;
+    fields << &map->warps_label;
+    fields << &map->coord_events_label;
+    fields << &map->bg_events_label;
+    fields << &map->blockdata_path;
+    fields << &map->border_path;
+    return fields;
+}
+
+static QList<QString*> getTilesetFields(Tileset *tileset) {
+    QList<QString*> fields;
+    fields << &tileset->name;
+    fields << &tileset->is_compressed;
+    fields << &tileset->is_secondary;
+    fields << &tileset->padding;
+    fields << &tileset->tiles_label;
+    fields << &tileset->palettes_label;
+    fields << &tileset->metatiles_label;
+    fields << &tileset->callback_label;
+    fields << &tileset->metatile_attrs_label;
+    return fields;
+}
+
+bool ProjectCache::restoreMap(Map *map) {
+    QByteArray data;
+    {
+        QMutexLocker locker(&lock);
+        if (!maps.contains(map->name)) {
+            return false;
+        }
+        data = maps.value(map->name);
+    }
+
+    QDataStream in(data);
+    in.setVersion(QDataStream::Qt_5_0);
+    QStringList sources;
+    QMap<QString, SourceStamp> stamps;
+    bool fresh = readSources(in, &sources, &stamps);
+
+    QStringList values;
+    QMap<QString, QList<Event*>> events;
+    QList<Connection*> connections;
+    if (fresh) {
+        int num_fields = getMapFields(map).length();
+        for (int i = 0; i < num_fields; i++) {
+            QString value;
+            in >> value;
+            values.append(value);
+        }
+        quint32 num_types = 0;
+        in >> num_types;
+        for (quint32 i = 0; i < num_types && in.status() == QDataStream::Ok; i++) {
+            QString type;
+            quint32 count = 0;
+            in >> type >> count;
+            for (quint32 j = 0; j < count && in.status() == QDataStream::Ok; j++) {
+                Event *event = new Event;
+                in >> event->values;
+                events[type].append(event);
+            }
+        }
+        quint32 num_connections = 0;
+        in >> num_connections;
+        for (quint32 i = 0; i < num_connections && in.status() == QDataStream::Ok; i++) {
+            Connection *connection = new Connection;
+            in >> connection->direction >> connection->offset >> connection->map_name;
+            connections.append(connection);
+        }
+    }
+
+    if (!fresh || in.status() != QDataStream::Ok) {
+        for (QList<Event*> list : events.values()) {
+            qDeleteAll(list);
+        }
+        qDeleteAll(connections);
+        QMutexLocker locker(&lock);
+        maps.remove(map->name);
+        dirty = true;
+        return false;
+    }
+
+    QList<QString*> fields = getMapFields(map);
+    for (int i = 0; i < fields.length(); i++) {
+        *fields.value(i) = values.value(i);
+    }
+    // The map may already be loaded, if it's being reloaded. Free what this replaces.
+    for (QList<Event*> list : map->events.values()) {
+        qDeleteAll(list);
+    }
+    qDeleteAll(map->connections);
+    map->events = events;
+    map->connections = connections;
+    map->sources = sources;
+    map->source_stamps = stamps;
+    map->from_cache = true;
+    return true;
+}
+
+void ProjectCache::storeMap(Map *map) {
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+    writeSources(out, map->sources, map->source_stamps);
+    for (QString *field : getMapFields(map)) {
+        out << *field;
+    }
+    out << (quint32)map->events.count();
+    for (QString type : map->events.keys()) {
+        QList<Event*> list = map->events.value(type);
+        out << type << (quint32)list.length();
+        for (Event *event : list) {
+            out << event->values;
+        }
+    }
+    out << (quint32)map->connections.length();
+    for (Connection *connection : map->connections) {
+        out << connection->direction << connection->offset << connection->map_name;
+    }
+
+    QMutexLocker locker(&lock);
+    maps.insert(map->name, data);
+    dirty = true;
+}
+
+// Images are stored as raw scanlines so they don't need to be decoded again.
+static void writeImage(QDataStream &out, const QImage &image) {
+    out << (qint32)image.format() << (qint32)image.width() << (qint32)image.height();
+    if (image.isNull()) {
+        return;
+    }
+    out << image.colorTable();
+    for (int y = 0; y < image.height(); y++) {
+        out.writeRawData((const char*)image.constScanLine(y), image.bytesPerLine());
+    }
+}
+
+static QImage readImage(QDataStream &in) {
+    qint32 format, width, height;
+    in >> format >> width >> height;
+    if (format == QImage::Format_Invalid || width <= 0 || height <= 0) {
+        return QImage();
+    }
+    QVector<QRgb> colors;
+    in >> colors;
+    QImage image(width, height, (QImage::Format)format);
+    image.setColorTable(colors);
+    for (int y = 0; y < height; y++) {
+        in.readRawData((char*)image.scanLine(y), image.bytesPerLine());
+    }
+    return image;
+}
+
+bool ProjectCache::restoreTileset(QString label, Tileset *tileset) {
+    QByteArray data;
+    {
+        QMutexLocker locker(&lock);
+        if (!tilesets.contains(label)) {
+            return false;
+        }
+        data = tilesets.value(label);
+    }
+
+    QDataStream in(data);
+    in.setVersion(QDataStream::Qt_5_0);
+    QStringList sources;
+    QMap<QString, SourceStamp> stamps;
+    bool fresh = readSources(in, &sources, &stamps);
+
+    QStringList values;
+    QList<QImage> *tiles = new QList<QImage>;
+    QList<Metatile*> *metatiles = new QList<Metatile*>;
+    QList<QList<QRgb>> *palettes = new QList<QList<QRgb>>;
+    if (fresh) {
+        int num_fields = getTilesetFields(tileset).length();
+        for (int i = 0; i < num_fields; i++) {
+            QString value;
+            in >> value;
+            values.append(value);
+        }
+        quint32 num_tiles = 0;
+        in >> num_tiles;
+        for (quint32 i = 0; i < num_tiles && in.status() == QDataStream::Ok; i++) {
+            tiles->append(readImage(in));
+        }
+        quint32 num_metatiles = 0;
+        in >> num_metatiles;
+        for (quint32 i = 0; i < num_metatiles && in.status() == QDataStream::Ok; i++) {
+            Metatile *metatile = new Metatile;
+            qint32 attr;
+            in >> attr;
+            metatile->attr = attr;
+            for (int j = 0; j < 8; j++) {
+                quint16 word;
+                in >> word;
+                Tile tile;
+                tile.tile = word & 0x3ff;
+                tile.xflip = (word >> 10) & 1;
+                tile.yflip = (word >> 11) & 1;
+                tile.palette = (word >> 12) & 0xf;
+                metatile->tiles->append(tile);
+            }
+            metatiles->append(metatile);
+        }
+        in >> *palettes;
+    }
+
+    if (!fresh || in.status() != QDataStream::Ok) {
+        delete tiles;
+        for (Metatile *metatile : *metatiles) {
+            delete metatile->tiles;
+            delete metatile;
+        }
+        delete metatiles;
+        delete palettes;
+        QMutexLocker locker(&lock);
+        tilesets.remove(label);
+        dirty = true;
+        return false;
+    }
+
+    QList<QString*> fields = getTilesetFields(tileset);
+    for (int i = 0; i < fields.length(); i++) {
+        *fields.value(i) = values.value(i);
+    }
+    tileset->tiles = tiles;
+    tileset->metatiles = metatiles;
+    tileset->palettes = palettes;
+    tileset->sources = sources;
+    tileset->source_stamps = stamps;
+    return true;
+}
+
+void ProjectCache::storeTileset(QString label, Tileset *tileset) {
+    QByteArray data;
+    QDataStream out(&data, QIODevice::WriteOnly);
+    out.setVersion(QDataStream::Qt_5_0);
+    writeSources(out, tileset->sources, tileset->source_stamps);
+    for (QString *field : getTilesetFields(tileset)) {
+        out << *field;
+    }
+    QList<QImage> tiles = tileset->tiles ? *tileset->tiles : QList<QImage>();
+    out << (quint32)tiles.length();
+    for (QImage tile : tiles) {
+        writeImage(out, tile);
+    }
+    QList<Metatile*> metatiles = tileset->metatiles ? *tileset->metatiles : QList<Metatile*>();
+    out << (quint32)metatiles.length();
+    for (Metatile *metatile : metatiles) {
+        out << (qint32)metatile->attr;
+        for (int j = 0; j < 8; j++) {
+            Tile tile = metatile->tiles->value(j);
+            quint16 word = (tile.tile & 0x3ff) | ((tile.xflip & 1) << 10) | ((tile.yflip & 1) << 11) | ((tile.palette & 0xf) << 12);
+            out << word;
+        }
+    }
+    out << (tileset->palettes ? *tileset->palettes : QList<QList<QRgb>>());
+
+    QMutexLocker locker(&lock);
+    tilesets.insert(label, data);
+    dirty = true;
+}
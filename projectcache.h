@@ -0,0 +1,38 @@
+#ifndef PROJECTCACHE_H
+#define PROJECTCACHE_H
+
+#include "map.h"
+#include "tileset.h"
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QMap>
+#include <QMutex>
+
+// Parsed map headers and decoded tilesets, kept on disk between sessions.
+// Each entry records the files it was built from, and is thrown out when any of them change.
+class ProjectCache
+{
+public:
+    ProjectCache(QString root_);
+
+public:
+    QString root;
+    QString path;
+    void load();
+    void save();
+
+    bool restoreMap(Map *map);
+    void storeMap(Map *map);
+    bool restoreTileset(QString label, Tileset *tileset);
+    void storeTileset(QString label, Tileset *tileset);
+
+private:
+    QMap<QString, QByteArray> maps;
+    QMap<QString, QByteArray> tilesets;
+    bool dirty = false;
+    QMutex lock;
+};
+
+#endif // PROJECTCACHE_H
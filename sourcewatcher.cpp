@@ -0,0 +1,195 @@
+#include "sourcewatcher.h"
+
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QDebug>
+
+SourceWatcher::SourceWatcher(QObject *parent) : QObject(parent)
+{
+    watcher = new QFileSystemWatcher(this);
+    connect(watcher, SIGNAL(fileChanged(QString)), this, SLOT(onFileChanged(QString)));
+
+    // Build scripts tend to touch several files at once. Handle them together.
+    timer = new QTimer(this);
+    timer->setSingleShot(true);
+    timer->setInterval(250);
+    connect(timer, SIGNAL(timeout()), this, SLOT(reloadChanged()));
+}
+
+static SourceStamp currentStamp(QString path) {
+    QFileInfo info(path);
+    if (!info.exists()) {
+        return SourceStamp(-1, -1);
+    }
+    return SourceStamp(info.lastModified().toMSecsSinceEpoch(), info.size());
+}
+
+void SourceWatcher::setProject(Project *project_) {
+    project = project_;
+    QStringList files = watcher->files();
+    if (!files.isEmpty()) {
+        watcher->removePaths(files);
+    }
+    map_paths.clear();
+    tileset_paths.clear();
+    watched.clear();
+    unwatched_stamps.clear();
+    changed.clear();
+}
+
+void SourceWatcher::watch(QString path) {
+    if (path.isEmpty() || watched.contains(path) || !QFileInfo(path).exists()) {
+        return;
+    }
+    if (!watcher->addPath(path)) {
+        qDebug() << QString("Could not watch '%1'. Changes to it won't be reloaded.").arg(path);
+        return;
+    }
+    watched.insert(path);
+    if (unwatched_stamps.contains(path)) {
+        if (unwatched_stamps.take(path) != currentStamp(path)) {
+            changed.insert(path);
+            timer->start();
+        }
+    }
+}
+
+void SourceWatcher::unwatch(QString path) {
+    watcher->removePath(path);
+    watched.remove(path);
+    unwatched_stamps.insert(path, currentStamp(path));
+}
+
+// Files that are replaced rather than rewritten drop out of the watcher.
+void SourceWatcher::rewatch(QString path) {
+    if (watched.contains(path) && !watcher->files().contains(path)) {
+        watched.remove(path);
+    }
+    watch(path);
+}
+
+// Files that were never watched are compared against when they were read.
+void SourceWatcher::stampUnwatched(QString path, QMap<QString, SourceStamp> stamps) {
+    if (!watched.contains(path) && !unwatched_stamps.contains(path) && stamps.contains(path)) {
+        unwatched_stamps.insert(path, stamps.value(path));
+    }
+}
+
+void SourceWatcher::watchMap(Map *map) {
+    QStringList paths = map->sources;
+    paths << map->blockdata_path;
+    paths << map->border_path;
+    for (QString path : paths) {
+        if (path.isEmpty()) {
+            continue;
+        }
+        map_paths[path].insert(map->name);
+        stampUnwatched(path, map->source_stamps);
+        watch(path);
+    }
+}
+
+void SourceWatcher::watchTileset(QString label, Tileset *tileset) {
+    for (QString path : tileset->sources) {
+        tileset_paths[path].insert(label);
+        stampUnwatched(path, tileset->source_stamps);
+        watch(path);
+    }
+}
+
+// Watches what's on screen or unsaved now, and stops watching everything else.
+void SourceWatcher::watchCache() {
+    if (!project) {
+        return;
+    }
+    QSet<QString> wanted;
+    QSet<Tileset*> used;
+    for (Map *map : project->map_cache->values()) {
+        if (!project->pinned_maps.contains(map->name) && !map->hasUnsavedChanges()) {
+            continue;
+        }
+        watchMap(map);
+        wanted.unite(QSet<QString>::fromList(map->sources));
+        wanted << map->blockdata_path << map->border_path;
+        used << map->tileset_primary << map->tileset_secondary;
+    }
+    QMap<QString, Tileset*> tilesets;
+    {
+        QMutexLocker locker(&project->cache_lock);
+        tilesets = *project->tileset_cache;
+    }
+    for (QString label : tilesets.keys()) {
+        Tileset *tileset = tilesets.value(label);
+        if (used.contains(tileset)) {
+            watchTileset(label, tileset);
+            wanted.unite(QSet<QString>::fromList(tileset->sources));
+        }
+    }
+    for (QString path : watched.values()) {
+        if (!wanted.contains(path)) {
+            unwatch(path);
+        }
+    }
+}
+
+void SourceWatcher::onFileChanged(QString path) {
+    if (project && project->isOwnWrite(path)) {
+        rewatch(path);
+        return;
+    }
+    changed.insert(path);
+    timer->start();
+}
+
+void SourceWatcher::reloadChanged() {
+    QSet<QString> paths = changed;
+    changed.clear();
+    if (!project) {
+        return;
+    }
+
+    QSet<QString> labels;
+    QSet<QString> map_names;
+    for (QString path : paths) {
+        rewatch(path);
+        // A save of ours may have finished since the change came in.
+        if (project->isOwnWrite(path)) {
+            continue;
+        }
+        labels.unite(tileset_paths.value(path));
+        map_names.unite(map_paths.value(path));
+    }
+
+    for (QString label : labels) {
+        project->reloadTileset(label);
+        Tileset *tileset;
+        {
+            QMutexLocker locker(&project->cache_lock);
+            tileset = project->tileset_cache->value(label, NULL);
+        }
+        if (!tileset) {
+            continue;
+        }
+        watchTileset(label, tileset);
+        for (Map *map : project->map_cache->values()) {
+            if (map->tileset_primary == tileset || map->tileset_secondary == tileset) {
+                map->clearRenderCache();
+            }
+        }
+        emit tilesetReloaded(tileset);
+    }
+
+    for (QString map_name : map_names) {
+        Map *map = project->map_cache->value(map_name, NULL);
+        if (!map) {
+            continue;
+        }
+        if (map->hasUnsavedChanges()) {
+            qDebug() << QString("%1 changed on disk, but has unsaved changes. Not reloading.").arg(map_name);
+            continue;
+        }
+        project->reloadMap(map);
+        watchMap(map);
+        emit mapReloaded(map);
+    }
+}
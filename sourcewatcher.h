@@ -0,0 +1,52 @@
+#ifndef SOURCEWATCHER_H
+#define SOURCEWATCHER_H
+
+#include "project.h"
+
+#include <QObject>
+#include <QFileSystemWatcher>
+#include <QHash>
+#include <QSet>
+#include <QTimer>
+
+// Watches the files that the maps on screen and maps with unsaved changes were built from,
+// along with their tilesets, and reloads only the ones affected when something changes on disk.
+// Other cached maps aren't watched, so large projects stay under the system's limit on watches.
+// A file is stamped when it stops being watched, and counts as changed if it differs once it's watched again.
+class SourceWatcher : public QObject
+{
+    Q_OBJECT
+public:
+    explicit SourceWatcher(QObject *parent = 0);
+
+public:
+    Project *project = NULL;
+    void setProject(Project *project_);
+    void watchMap(Map *map);
+    void watchTileset(QString label, Tileset *tileset);
+    void watchCache();
+
+signals:
+    void mapReloaded(Map *map);
+    void tilesetReloaded(Tileset *tileset);
+
+private slots:
+    void onFileChanged(QString path);
+    void reloadChanged();
+
+private:
+    void watch(QString path);
+    void unwatch(QString path);
+    void rewatch(QString path);
+    void stampUnwatched(QString path, QMap<QString, SourceStamp> stamps);
+    QFileSystemWatcher *watcher = NULL;
+    QTimer *timer = NULL;
+    // path -> the maps and tilesets built from it
+    QHash<QString, QSet<QString>> map_paths;
+    QHash<QString, QSet<QString>> tileset_paths;
+    QSet<QString> watched;
+    QHash<QString, SourceStamp> unwatched_stamps;
+    QSet<QString> changed;
+};
+
+#endif // SOURCEWATCHER_H
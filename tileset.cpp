@@ -4,3 +4,20 @@ Tileset::Tileset()
 {
 
 }
+
+// A rough estimate, for the cache budget.
+qint64 Tileset::memoryUsage() {
+    qint64 total = 0;
+    if (tiles) {
+        for (QImage tile : *tiles) {
+            total += (qint64)tile.bytesPerLine() * tile.height() + 64;
+        }
+    }
+    if (metatiles) {
+        total += (qint64)metatiles->length() * (8 * (sizeof(void*) + 16) + 64);
+    }
+    if (palettes) {
+        total += (qint64)palettes->length() * 16 * sizeof(QRgb);
+    }
+    return total;
+}
@@ -3,6 +3,12 @@
 
 #include "metatile.h"
 #include <QImage>
+#include <QStringList>
+#include <QMap>
+#include <QPair>
+
+// A source file's mtime and size when it was read, or -1 and -1 if it didn't exist.
+typedef QPair<qint64, qint64> SourceStamp;
 
 class Tileset
 {
@@ -22,6 +28,12 @@ public:
     QList<QImage> *tiles = NULL;
     QList<Metatile*> *metatiles = NULL;
     QList<QList<QRgb>> *palettes = NULL;
+
+    // The files this tileset was built from.
+    QStringList sources;
+    QMap<QString, SourceStamp> source_stamps;
+
+    qint64 memoryUsage();
 };
 
 #endif // TILESET_H
@@ -0,0 +1,18 @@
+#-------------------------------------------------
+#
+# Writes synthetic projects for benchmarks and soak tests.
+# Build and run with: qmake && make && ./pretmap_generator --help
+#
+#-------------------------------------------------
+
+QT       += core gui
+
+TARGET = pretmap_generator
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+SOURCES += main.cpp \
+    projectgenerator.cpp
+
+HEADERS  += projectgenerator.h
@@ -0,0 +1,67 @@
+#include "projectgenerator.h"
+
+#include <QCoreApplication>
+#include <QCommandLineParser>
+#include <QElapsedTimer>
+#include <QTextStream>
+
+int main(int argc, char *argv[])
+{
+    QCoreApplication app(argc, argv);
+    QCoreApplication::setApplicationName("pretmap_generator");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Writes a synthetic pokeruby-style project for benchmarks and soak tests.");
+    parser.addHelpOption();
+    parser.addPositionalArgument("root", "Directory to write the project to.");
+
+    GeneratorOptions defaults;
+    QList<QCommandLineOption> options;
+    QCommandLineOption maps("maps", "Number of maps.", "count", QString::number(defaults.num_maps));
+    QCommandLineOption maps_per_group("maps-per-group", "Maps in each map group.", "count", QString::number(defaults.maps_per_group));
+    QCommandLineOption width("width", "Map width in blocks.", "blocks", QString::number(defaults.map_width));
+    QCommandLineOption height("height", "Map height in blocks.", "blocks", QString::number(defaults.map_height));
+    QCommandLineOption events("events", "Events per map.", "count", QString::number(defaults.events_per_map));
+    QCommandLineOption secondary_tilesets("secondary-tilesets", "Number of secondary tilesets.", "count", QString::number(defaults.num_secondary_tilesets));
+    QCommandLineOption primary_tiles("primary-tiles", "Tiles in the primary tileset.", "count", QString::number(defaults.primary_tiles));
+    QCommandLineOption primary_metatiles("primary-metatiles", "Metatiles in the primary tileset.", "count", QString::number(defaults.primary_metatiles));
+    QCommandLineOption secondary_tiles("secondary-tiles", "Tiles in each secondary tileset.", "count", QString::number(defaults.secondary_tiles));
+    QCommandLineOption secondary_metatiles("secondary-metatiles", "Metatiles in each secondary tileset.", "count", QString::number(defaults.secondary_metatiles));
+    QCommandLineOption no_connections("no-connections", "Don't connect the maps to each other.");
+    QCommandLineOption seed("seed", "Seed for the generated contents.", "seed", QString::number(defaults.seed));
+    options << maps << maps_per_group << width << height << events << secondary_tilesets;
+    options << primary_tiles << primary_metatiles << secondary_tiles << secondary_metatiles << no_connections << seed;
+    parser.addOptions(options);
+    parser.process(app);
+
+    QTextStream out(stdout);
+    QTextStream err(stderr);
+    QStringList args = parser.positionalArguments();
+    if (args.length() != 1) {
+        parser.showHelp(1);
+    }
+
+    GeneratorOptions generator_options;
+    generator_options.num_maps = parser.value(maps).toInt();
+    generator_options.maps_per_group = parser.value(maps_per_group).toInt();
+    generator_options.map_width = parser.value(width).toInt();
+    generator_options.map_height = parser.value(height).toInt();
+    generator_options.events_per_map = parser.value(events).toInt();
+    generator_options.num_secondary_tilesets = parser.value(secondary_tilesets).toInt();
+    generator_options.primary_tiles = qBound(0, parser.value(primary_tiles).toInt(), 512);
+    generator_options.primary_metatiles = qBound(0, parser.value(primary_metatiles).toInt(), 512);
+    generator_options.secondary_tiles = qBound(0, parser.value(secondary_tiles).toInt(), 512);
+    generator_options.secondary_metatiles = qBound(0, parser.value(secondary_metatiles).toInt(), 512);
+    generator_options.connections = !parser.isSet(no_connections);
+    generator_options.seed = parser.value(seed).toUInt();
+
+    QElapsedTimer timer;
+    timer.start();
+    ProjectGenerator generator(args.value(0), generator_options);
+    if (!generator.generate()) {
+        err << QString("Could not write the project to '%1'\n").arg(generator.root);
+        return 1;
+    }
+    out << QString("Wrote %1 maps to '%2' in %3 ms\n").arg(generator_options.num_maps).arg(generator.root).arg(timer.elapsed());
+    return 0;
+}
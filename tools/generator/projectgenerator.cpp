@@ -0,0 +1,316 @@
+#include "projectgenerator.h"
+
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QImage>
+
+static QByteArray words(QList<quint16> values) {
+    QByteArray data;
+    data.reserve(values.length() * 2);
+    for (quint16 value : values) {
+        data.append((char)(value & 0xff));
+        data.append((char)(value >> 8));
+    }
+    return data;
+}
+
+ProjectGenerator::ProjectGenerator(QString root_, GeneratorOptions options_)
+{
+    root = root_;
+    options = options_;
+}
+
+// A fixed lcg rather than qrand, so the output doesn't depend on the platform.
+int ProjectGenerator::random(int max) {
+    state = state * 1103515245 + 12345;
+    if (max <= 0) {
+        return 0;
+    }
+    return (state >> 16) % max;
+}
+
+bool ProjectGenerator::writeFile(QString path, QByteArray data) {
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        return false;
+    }
+    return file.write(data) == data.length();
+}
+
+QString ProjectGenerator::getMapName(int index) {
+    return QString("GenMap%1").arg(index);
+}
+
+QString ProjectGenerator::getSecondaryTilesetName(int index) {
+    return QString("Gen%1").arg(index);
+}
+
+QString ProjectGenerator::getTilesetDir(QString name, bool secondary) {
+    return QString("data/tilesets/%1/%2").arg(secondary ? "secondary" : "primary").arg(name.toLower());
+}
+
+bool ProjectGenerator::generate() {
+    state = options.seed;
+    int maps_per_group = qMax(1, options.maps_per_group);
+    int num_groups = (options.num_maps + maps_per_group - 1) / maps_per_group;
+
+    QString groups;
+    for (int group = 0; group < num_groups; group++) {
+        groups += QString("\t.align 2\ngMapGroup%1::\n").arg(group);
+        for (int i = group * maps_per_group; i < options.num_maps && i < (group + 1) * maps_per_group; i++) {
+            groups += QString("\t.4byte %1\n").arg(getMapName(i));
+        }
+        groups += "\n";
+    }
+    groups += "\t.align 2\ngMapGroups::\n";
+    for (int group = 0; group < num_groups; group++) {
+        groups += QString("\t.4byte gMapGroup%1\n").arg(group);
+    }
+
+    QString assets;
+    for (int i = 0; i < options.num_maps; i++) {
+        QString map_name = getMapName(i);
+        assets += QString("%1_MapBorder::\n").arg(map_name);
+        assets += QString("\t.incbin \"data/maps/%1/border.bin\"\n\n").arg(map_name);
+        assets += QString("%1_MapBlockdata::\n").arg(map_name);
+        assets += QString("\t.incbin \"data/maps/%1/map.bin\"\n\n").arg(map_name);
+        assets += QString("\t.align 2\n%1_MapAttributes::\n").arg(map_name);
+        assets += QString("\t.4byte %1\n").arg(options.map_width);
+        assets += QString("\t.4byte %1\n").arg(options.map_height);
+        assets += QString("\t.4byte %1_MapBorder\n").arg(map_name);
+        assets += QString("\t.4byte %1_MapBlockdata\n").arg(map_name);
+        assets += "\t.4byte gTileset_General\n";
+        assets += QString("\t.4byte gTileset_%1\n\n").arg(getSecondaryTilesetName(i % qMax(1, options.num_secondary_tilesets)));
+        if (!writeMap(i)) {
+            return false;
+        }
+    }
+
+    QString headers = getTilesetHeader("General", false);
+    QString graphics = getTilesetGraphics("General", false);
+    QString metatiles = getTilesetMetatiles("General", false);
+    if (!writeTileset("General", false)) {
+        return false;
+    }
+    for (int i = 0; i < qMax(1, options.num_secondary_tilesets); i++) {
+        QString name = getSecondaryTilesetName(i);
+        headers += getTilesetHeader(name, true);
+        graphics += getTilesetGraphics(name, true);
+        metatiles += getTilesetMetatiles(name, true);
+        if (!writeTileset(name, true)) {
+            return false;
+        }
+    }
+
+    return writeFile(root + "/data/maps/_groups.inc", groups.toUtf8())
+        && writeFile(root + "/data/maps/_assets.inc", assets.toUtf8())
+        && writeFile(root + "/data/tilesets/headers.inc", headers.toUtf8())
+        && writeFile(root + "/data/tilesets/graphics.inc", graphics.toUtf8())
+        && writeFile(root + "/data/tilesets/metatiles.inc", metatiles.toUtf8());
+}
+
+bool ProjectGenerator::writeMap(int index) {
+    QString map_name = getMapName(index);
+    QString dir = root + "/data/maps/" + map_name;
+    bool ok = writeFile(dir + "/header.inc", getMapHeader(index).toUtf8())
+        && writeFile(dir + "/map.bin", getBlockdata(options.map_width, options.map_height))
+        && writeFile(dir + "/border.bin", getBlockdata(2, 2))
+        && writeFile(root + "/data/maps/events/" + map_name + ".inc", getMapEvents(index).toUtf8());
+    if (ok && options.connections) {
+        ok = writeFile(dir + "/connections.inc", getMapConnections(index).toUtf8());
+    }
+    return ok;
+}
+
+bool ProjectGenerator::writeTileset(QString name, bool secondary) {
+    QString dir = root + "/" + getTilesetDir(name, secondary);
+    int num_tiles = secondary ? options.secondary_tiles : options.primary_tiles;
+    int num_metatiles = secondary ? options.secondary_metatiles : options.primary_metatiles;
+
+    // 4bpp tiles are stored as indexed pngs, 16 tiles to a row.
+    int rows = qMax(1, (num_tiles + 15) / 16);
+    QImage tiles(16 * 8, rows * 8, QImage::Format_Indexed8);
+    QVector<QRgb> colors;
+    for (int i = 0; i < 16; i++) {
+        colors.append(qRgb(i * 16, i * 16, i * 16));
+    }
+    tiles.setColorTable(colors);
+    for (int y = 0; y < tiles.height(); y++) {
+        uchar *line = tiles.scanLine(y);
+        for (int x = 0; x < tiles.width(); x++) {
+            line[x] = random(16);
+        }
+    }
+    QDir().mkpath(dir);
+    if (!tiles.save(dir + "/tiles.png")) {
+        return false;
+    }
+
+    for (int i = 0; i < 16; i++) {
+        QList<quint16> palette;
+        for (int j = 0; j < 16; j++) {
+            palette.append(random(0x8000));
+        }
+        QString path = QString("%1/palettes/%2.gbapal").arg(dir).arg(i, 2, 10, QLatin1Char('0'));
+        if (!writeFile(path, words(palette))) {
+            return false;
+        }
+    }
+
+    // Secondary tiles and metatiles are numbered after the primary ones.
+    int tile_base = secondary ? 512 : 0;
+    QList<quint16> metatiles;
+    QList<quint16> attrs;
+    for (int i = 0; i < num_metatiles; i++) {
+        for (int j = 0; j < 8; j++) {
+            int tile = tile_base + random(qMax(1, num_tiles));
+            int xflip = random(2);
+            int yflip = random(2);
+            int palette = secondary ? 6 + random(7) : random(6);
+            metatiles.append(tile | (xflip << 10) | (yflip << 11) | (palette << 12));
+        }
+        attrs.append(random(0x100));
+    }
+    return writeFile(dir + "/metatiles.bin", words(metatiles))
+        && writeFile(dir + "/metatile_attributes.bin", words(attrs));
+}
+
+QString ProjectGenerator::getTilesetHeader(QString name, bool secondary) {
+    QString text;
+    text += QString("gTileset_%1::\n").arg(name);
+    text += "\t.byte TRUE @ is compressed\n";
+    text += QString("\t.byte %1 @ is secondary\n").arg(secondary ? "TRUE" : "FALSE");
+    text += "\t.2byte 0 @ padding\n";
+    text += QString("\t.4byte gTilesetTiles_%1\n").arg(name);
+    text += QString("\t.4byte gTilesetPalettes_%1\n").arg(name);
+    text += QString("\t.4byte gMetatiles_%1\n").arg(name);
+    text += QString("\t.4byte gMetatileAttributes_%1\n").arg(name);
+    text += "\t.4byte NULL\n\n";
+    return text;
+}
+
+QString ProjectGenerator::getTilesetGraphics(QString name, bool secondary) {
+    QString dir = getTilesetDir(name, secondary);
+    QString text;
+    text += QString("\t.align 2\ngTilesetPalettes_%1::\n").arg(name);
+    for (int i = 0; i < 16; i++) {
+        text += QString("\t.incbin \"%1/palettes/%2.gbapal\"\n").arg(dir).arg(i, 2, 10, QLatin1Char('0'));
+    }
+    text += QString("\n\t.align 2\ngTilesetTiles_%1::\n").arg(name);
+    text += QString("\t.incbin \"%1/tiles.4bpp.lz\"\n\n").arg(dir);
+    return text;
+}
+
+QString ProjectGenerator::getTilesetMetatiles(QString name, bool secondary) {
+    QString dir = getTilesetDir(name, secondary);
+    QString text;
+    text += QString("\t.align 1\ngMetatiles_%1::\n").arg(name);
+    text += QString("\t.incbin \"%1/metatiles.bin\"\n\n").arg(dir);
+    text += QString("\t.align 1\ngMetatileAttributes_%1::\n").arg(name);
+    text += QString("\t.incbin \"%1/metatile_attributes.bin\"\n\n").arg(dir);
+    return text;
+}
+
+QString ProjectGenerator::getMapHeader(int index) {
+    QString map_name = getMapName(index);
+    QString text;
+    text += QString("%1::\n").arg(map_name);
+    text += QString("\t.4byte %1_MapAttributes\n").arg(map_name);
+    text += QString("\t.4byte %1_MapEvents\n").arg(map_name);
+    text += QString("\t.4byte %1_MapScripts\n").arg(map_name);
+    if (options.connections) {
+        text += QString("\t.4byte %1_MapConnections\n").arg(map_name);
+    } else {
+        text += "\t.4byte 0x0\n";
+    }
+    text += "\t.2byte BGM_PETALBURG\n";
+    text += QString("\t.2byte %1\n").arg(index);
+    text += QString("\t.byte %1\n").arg(random(88));
+    text += "\t.byte 0\n";
+    text += QString("\t.byte %1\n").arg(random(15));
+    text += "\t.byte 1\n";
+    text += "\t.2byte 0\n";
+    text += "\t.byte 1\n";
+    text += "\t.byte 0\n";
+    return text;
+}
+
+// Object events use the old 20 argument macro, like most existing trees.
+QString ProjectGenerator::getMapEvents(int index) {
+    QString map_name = getMapName(index);
+    int width = qMax(1, options.map_width);
+    int height = qMax(1, options.map_height);
+    int num_objects = options.events_per_map / 2;
+    int num_others = (options.events_per_map - num_objects) / 3;
+
+    QString text;
+    text += QString("%1_EventObjects::\n").arg(map_name);
+    for (int i = 0; i < num_objects; i++) {
+        int x = random(width);
+        int y = random(height);
+        text += QString("\tobject_event %1, MAP_OBJ_GFX_BOY_1, 0, %2, %3, %4, %5, 3, %6, 17, 0, 0, 0, 0, 0, %7_EventScript_%1, 0, 0, 0, 0\n")
+                .arg(i + 1).arg(x & 0xff).arg(x >> 8).arg(y & 0xff).arg(y >> 8).arg(1 + random(10)).arg(map_name);
+    }
+    text += "\n";
+    text += QString("%1_MapWarps::\n").arg(map_name);
+    for (int i = 0; i < num_others; i++) {
+        text += QString("\twarp_def %1, %2, 0, %3, %4\n").arg(random(width)).arg(random(height)).arg(i).arg(getMapName(random(options.num_maps)));
+    }
+    text += "\n";
+    text += QString("%1_MapCoordEvents::\n").arg(map_name);
+    for (int i = 0; i < num_others; i++) {
+        text += QString("\tcoord_event %1, %2, 3, 0, 0x4050, 1, 0, %3_EventScript_Trap%4\n").arg(random(width)).arg(random(height)).arg(map_name).arg(i);
+    }
+    text += "\n";
+    text += QString("%1_MapBGEvents::\n").arg(map_name);
+    for (int i = 0; i < num_others; i++) {
+        text += QString("\tbg_event %1, %2, 0, 0, 0, %3_EventScript_Sign%4\n").arg(random(width)).arg(random(height)).arg(map_name).arg(i);
+    }
+    text += "\n";
+    text += QString("%1_MapEvents::\n").arg(map_name);
+    text += QString("\tmap_events %1_EventObjects, %1_MapWarps, %1_MapCoordEvents, %1_MapBGEvents\n").arg(map_name);
+    return text;
+}
+
+// Maps are chained together, each one below the last.
+QString ProjectGenerator::getMapConnections(int index) {
+    QString map_name = getMapName(index);
+    QStringList connections;
+    if (index > 0) {
+        connections << QString("\tconnection up, 0, %1, 0\n").arg(getMapName(index - 1));
+    }
+    if (index + 1 < options.num_maps) {
+        connections << QString("\tconnection down, 0, %1, 0\n").arg(getMapName(index + 1));
+    }
+    QString text;
+    text += QString("%1_MapConnectionsList::\n").arg(map_name);
+    text += connections.join("");
+    text += "\n";
+    text += QString("%1_MapConnections::\n").arg(map_name);
+    text += QString("\t.4byte 0x%1\n").arg(connections.length());
+    text += QString("\t.4byte %1_MapConnectionsList\n").arg(map_name);
+    return text;
+}
+
+// Metatiles come in runs, so there is something for flood fill to do.
+QByteArray ProjectGenerator::getBlockdata(int width, int height) {
+    int primary = qMax(1, options.primary_metatiles);
+    int secondary = options.secondary_metatiles;
+    QList<quint16> blocks;
+    int metatile = 0;
+    for (int i = 0; i < width * height; i++) {
+        if (i == 0 || random(8) == 0) {
+            if (secondary > 0 && random(2)) {
+                metatile = 512 + random(secondary);
+            } else {
+                metatile = random(primary);
+            }
+        }
+        int collision = random(4) == 0 ? 1 : 0;
+        int elevation = 3 + random(2);
+        blocks.append(metatile | (collision << 10) | (elevation << 12));
+    }
+    return words(blocks);
+}
@@ -0,0 +1,53 @@
+#ifndef PROJECTGENERATOR_H
+#define PROJECTGENERATOR_H
+
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+
+struct GeneratorOptions {
+    int num_maps = 8;
+    int maps_per_group = 64;
+    int map_width = 64;
+    int map_height = 64;
+    int events_per_map = 16;
+    int num_secondary_tilesets = 1;
+    int primary_tiles = 512;
+    int primary_metatiles = 512;
+    int secondary_tiles = 512;
+    int secondary_metatiles = 512;
+    bool connections = true;
+    quint32 seed = 1;
+};
+
+// Writes a synthetic project in the layout Project expects.
+// The same options always give the same files, so runs against it are comparable.
+class ProjectGenerator
+{
+public:
+    ProjectGenerator(QString root_, GeneratorOptions options_ = GeneratorOptions());
+
+public:
+    QString root;
+    GeneratorOptions options;
+    bool generate();
+    QString getMapName(int index);
+    QString getSecondaryTilesetName(int index);
+
+private:
+    quint32 state = 1;
+    int random(int max);
+    bool writeFile(QString path, QByteArray data);
+    bool writeMap(int index);
+    bool writeTileset(QString name, bool secondary);
+    QString getTilesetDir(QString name, bool secondary);
+    QString getTilesetHeader(QString name, bool secondary);
+    QString getTilesetGraphics(QString name, bool secondary);
+    QString getTilesetMetatiles(QString name, bool secondary);
+    QString getMapHeader(int index);
+    QString getMapEvents(int index);
+    QString getMapConnections(int index);
+    QByteArray getBlockdata(int width, int height);
+};
+
+#endif // PROJECTGENERATOR_H
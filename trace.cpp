@@ -0,0 +1,96 @@
+#include "trace.h"
+
+#include <QElapsedTimer>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QHash>
+#include <QVector>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QSaveFile>
+#include <QCoreApplication>
+#include <QDebug>
+
+QAtomicInt Trace::enabled(0);
+
+static QString trace_path;
+static QElapsedTimer trace_timer;
+static QMutex trace_lock;
+struct TraceEvent {
+    const char *name;
+    qint64 start;
+    qint64 duration;
+    int thread;
+    QJsonObject args;
+};
+
+static QVector<TraceEvent> trace_events;
+static QHash<Qt::HANDLE, int> trace_threads;
+
+void Trace::start(QString path) {
+    if (path.isEmpty()) {
+        return;
+    }
+    QMutexLocker locker(&trace_lock);
+    trace_path = path;
+    trace_timer.start();
+    enabled.storeRelease(1);
+}
+
+// Microseconds since tracing started.
+qint64 Trace::now() {
+    return trace_timer.nsecsElapsed() / 1000;
+}
+
+void Trace::record(const char *name, qint64 start, qint64 duration, QJsonObject args) {
+    QMutexLocker locker(&trace_lock);
+    if (!isEnabled()) {
+        return;
+    }
+    // Small thread ids read better in the viewer than raw handles.
+    Qt::HANDLE thread = QThread::currentThreadId();
+    if (!trace_threads.contains(thread)) {
+        trace_threads.insert(thread, trace_threads.count() + 1);
+    }
+    trace_events.append(TraceEvent{name, start, duration, trace_threads.value(thread), args});
+}
+
+// Writes everything recorded so far, and stops recording.
+void Trace::finish() {
+    QMutexLocker locker(&trace_lock);
+    if (!isEnabled()) {
+        return;
+    }
+    enabled.storeRelease(0);
+    double pid = QCoreApplication::applicationPid();
+    QJsonArray events;
+    for (const TraceEvent &trace_event : trace_events) {
+        QJsonObject event;
+        event.insert("name", QString(trace_event.name));
+        event.insert("cat", QString("pretmap"));
+        event.insert("ph", QString("X"));
+        event.insert("ts", (double)trace_event.start);
+        event.insert("dur", (double)trace_event.duration);
+        event.insert("pid", pid);
+        event.insert("tid", trace_event.thread);
+        if (!trace_event.args.isEmpty()) {
+            event.insert("args", trace_event.args);
+        }
+        events.append(event);
+    }
+    trace_events.clear();
+
+    QJsonObject root;
+    root.insert("traceEvents", events);
+    root.insert("displayTimeUnit", QString("ms"));
+    QSaveFile file(trace_path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        qDebug() << QString("Could not open '%1' for writing: ").arg(trace_path) + file.errorString();
+        return;
+    }
+    file.write(QJsonDocument(root).toJson(QJsonDocument::Compact));
+    if (!file.commit()) {
+        qDebug() << QString("Could not write '%1': ").arg(trace_path) + file.errorString();
+    }
+}
@@ -0,0 +1,59 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <QString>
+#include <QJsonObject>
+#include <QAtomicInt>
+
+// Records scoped spans as Chrome trace events (chrome://tracing, ui.perfetto.dev).
+// Turned on with the PRETMAP_TRACE environment variable or --trace <path>.
+// When off, a span is an atomic load on the way in and a null check on the way out.
+class Trace
+{
+public:
+    // Spans check this on worker threads while finish() may be clearing it.
+    static QAtomicInt enabled;
+    static bool isEnabled() {
+        return enabled.loadAcquire();
+    }
+    static void start(QString path);
+    static void finish();
+    static qint64 now();
+    static void record(const char *name, qint64 start, qint64 duration, QJsonObject args);
+};
+
+class TraceSpan
+{
+public:
+    explicit TraceSpan(const char *name_) {
+        if (Trace::isEnabled()) {
+            name = name_;
+            start = Trace::now();
+        }
+    }
+    ~TraceSpan() {
+        if (name) {
+            Trace::record(name, start, Trace::now() - start, args);
+        }
+    }
+    bool isActive() {
+        return name != NULL;
+    }
+    void arg(const char *key, QString value) {
+        args.insert(key, value);
+    }
+    void arg(const char *key, int value) {
+        args.insert(key, value);
+    }
+
+private:
+    const char *name = NULL;
+    qint64 start = 0;
+    QJsonObject args;
+};
+
+// Arguments are only evaluated while tracing.
+#define TRACE_SCOPE(name) TraceSpan trace_span(name)
+#define TRACE_ARG(key, value) do { if (trace_span.isActive()) trace_span.arg(key, value); } while (0)
+
+#endif // TRACE_H